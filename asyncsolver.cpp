@@ -0,0 +1,111 @@
+#include "asyncsolver.hpp"
+
+#include "solvedvalues.hpp"
+
+
+AsyncSolver::AsyncSolver(
+  SolveFunction solve_function_arg,
+  std::function<void()> notify_function_arg
+)
+: solve_function(std::move(solve_function_arg)),
+  notify_function(std::move(notify_function_arg)),
+  thread([this]{ runThread(); })
+{
+}
+
+
+AsyncSolver::~AsyncSolver()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+    cancel_flag = true;
+  }
+
+  request_condition.notify_one();
+  thread.join();
+}
+
+
+void AsyncSolver::request(const SceneState &scene_state)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++n_requests;
+    cancel_flag = true;
+    maybe_requested_state = scene_state;
+    maybe_result.reset();
+  }
+
+  request_condition.notify_one();
+}
+
+
+void AsyncSolver::cancel()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+  ++n_requests;
+  cancel_flag = true;
+  maybe_requested_state.reset();
+  maybe_result.reset();
+}
+
+
+Optional<AsyncSolver::Result> AsyncSolver::takeResult()
+{
+  std::lock_guard<std::mutex> lock(mutex);
+
+  if (!maybe_result) {
+    return {};
+  }
+
+  Optional<Result> result = std::move(maybe_result);
+  maybe_result.reset();
+  return result;
+}
+
+
+// The request number tells whether another request or a cancel came in
+// while solving, in which case the result is dropped, but the values are
+// kept for the newer request if there is one.
+void AsyncSolver::runThread()
+{
+  std::unique_lock<std::mutex> lock(mutex);
+
+  for (;;) {
+    request_condition.wait(
+      lock, [&]{ return stopping || maybe_requested_state.hasValue(); }
+    );
+
+    if (stopping) {
+      return;
+    }
+
+    Result result{std::move(*maybe_requested_state), SolveStats()};
+    maybe_requested_state.reset();
+    size_t request_number = n_requests;
+    cancel_flag = false;
+    lock.unlock();
+    result.stats = solve_function(result.scene_state, cancel_flag);
+    lock.lock();
+
+    if (request_number != n_requests) {
+      if (
+        maybe_requested_state &&
+        haveSameBodiesAndMeshes(result.scene_state, *maybe_requested_state)
+      ) {
+        copySolvedValues(result.scene_state, *maybe_requested_state);
+      }
+    }
+    else if (!result.stats.was_cancelled) {
+      maybe_result = std::move(result);
+      lock.unlock();
+
+      if (notify_function) {
+        notify_function();
+      }
+
+      lock.lock();
+    }
+  }
+}
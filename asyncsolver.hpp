@@ -0,0 +1,61 @@
+#ifndef ASYNCSOLVER_HPP_
+#define ASYNCSOLVER_HPP_
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "scenestate.hpp"
+#include "solvestats.hpp"
+
+
+// Solves copies of the scene state on a worker thread.  A new request
+// cancels the solve that is in progress, so only the result for the latest
+// request is ever given back.  The new request starts from the values that
+// the cancelled solve had reached, so that a drag keeps making progress
+// even when it moves again before any solve finishes.
+class AsyncSolver {
+  public:
+    using SolveFunction =
+      std::function<
+        SolveStats(SceneState &, const std::atomic<bool> &cancel_flag)
+      >;
+
+    struct Result {
+      SceneState scene_state;
+      SolveStats stats;
+    };
+
+    // The notify function is called on the worker thread after a result
+    // becomes available.
+    AsyncSolver(SolveFunction, std::function<void()> notify_function);
+    ~AsyncSolver();
+
+    void request(const SceneState &);
+
+    // Drops the latest request, along with its result if it has one.
+    void cancel();
+
+    // Returns the result of the latest request once it has been solved.
+    Optional<Result> takeResult();
+
+  private:
+    const SolveFunction solve_function;
+    const std::function<void()> notify_function;
+    std::mutex mutex;
+    std::condition_variable request_condition;
+    std::atomic<bool> cancel_flag{false};
+    Optional<SceneState> maybe_requested_state;
+    Optional<Result> maybe_result;
+    size_t n_requests = 0;
+    bool stopping = false;
+
+    // This is last so that the thread starts after everything else has
+    // been initialized.
+    std::thread thread;
+
+    void runThread();
+};
+
+#endif /* ASYNCSOLVER_HPP_ */
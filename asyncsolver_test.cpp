@@ -0,0 +1,153 @@
+#include "asyncsolver.hpp"
+
+#include <cassert>
+
+
+namespace {
+struct Notifier {
+  std::mutex mutex;
+  std::condition_variable condition;
+  int n_notifications = 0;
+
+  void notify()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      ++n_notifications;
+    }
+
+    condition.notify_one();
+  }
+
+  void waitFor(int n)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [&]{ return n_notifications >= n; });
+  }
+};
+}
+
+
+// Solving just sets the total error to one more than it was.  A scene with
+// a negative total error takes until it is cancelled.
+static SolveStats
+  fakeSolve(SceneState &scene_state, const std::atomic<bool> &cancel_flag)
+{
+  SolveStats stats;
+
+  if (scene_state.total_error < 0) {
+    while (!cancel_flag) {
+      std::this_thread::yield();
+    }
+
+    stats.was_cancelled = true;
+    return stats;
+  }
+
+  scene_state.total_error += 1;
+  stats.n_iterations = 1;
+  return stats;
+}
+
+
+static SceneState sceneWithTotalError(float total_error)
+{
+  SceneState scene_state;
+  scene_state.total_error = total_error;
+  return scene_state;
+}
+
+
+static void testRequest()
+{
+  Notifier notifier;
+  AsyncSolver solver(fakeSolve, [&]{ notifier.notify(); });
+  assert(!solver.takeResult());
+  solver.request(sceneWithTotalError(1));
+  notifier.waitFor(1);
+  Optional<AsyncSolver::Result> maybe_result = solver.takeResult();
+  assert(maybe_result);
+  assert(maybe_result->scene_state.total_error == 2);
+  assert(maybe_result->stats.n_iterations == 1);
+
+  // The result can only be taken once.
+  assert(!solver.takeResult());
+}
+
+
+static void testLatestRequestWins()
+{
+  Notifier notifier;
+  AsyncSolver solver(fakeSolve, [&]{ notifier.notify(); });
+  solver.request(sceneWithTotalError(-1));
+  solver.request(sceneWithTotalError(5));
+  notifier.waitFor(1);
+  Optional<AsyncSolver::Result> maybe_result = solver.takeResult();
+  assert(maybe_result);
+  assert(maybe_result->scene_state.total_error == 6);
+}
+
+
+static void testCancel()
+{
+  Notifier notifier;
+  AsyncSolver solver(fakeSolve, [&]{ notifier.notify(); });
+  solver.request(sceneWithTotalError(-1));
+  solver.cancel();
+  assert(!solver.takeResult());
+  solver.request(sceneWithTotalError(1));
+  notifier.waitFor(1);
+  assert(solver.takeResult()->scene_state.total_error == 2);
+}
+
+
+static void testNewRequestStartsFromCancelledSolve()
+{
+  Notifier started_notifier;
+  Notifier notifier;
+
+  // The first solve moves the body part way and then waits to be
+  // cancelled.
+  auto solve_function =
+    [&](SceneState &scene_state, const std::atomic<bool> &cancel_flag){
+      if (scene_state.total_error >= 0) {
+        return fakeSolve(scene_state, cancel_flag);
+      }
+
+      scene_state.body(BodyIndex(0)).transform.translation.x = 1;
+      started_notifier.notify();
+      return fakeSolve(scene_state, cancel_flag);
+    };
+
+  AsyncSolver solver(solve_function, [&]{ notifier.notify(); });
+  SceneState scene_state = sceneWithTotalError(-1);
+  BodyIndex body_index = scene_state.createBody();
+  scene_state.body(body_index).solve_flags.translation.x = true;
+  solver.request(scene_state);
+  started_notifier.waitFor(1);
+  scene_state.total_error = 5;
+  solver.request(scene_state);
+  notifier.waitFor(1);
+  Optional<AsyncSolver::Result> maybe_result = solver.takeResult();
+  assert(maybe_result);
+  const SceneState &result_state = maybe_result->scene_state;
+  assert(result_state.total_error == 6);
+  assert(result_state.body(body_index).transform.translation.x == 1);
+}
+
+
+static void testDestroyingWhileSolving()
+{
+  AsyncSolver solver(fakeSolve, /*notify_function*/{});
+  solver.request(sceneWithTotalError(-1));
+}
+
+
+int main()
+{
+  testRequest();
+  testLatestRequestWins();
+  testCancel();
+  testNewRequestStartsFromCancelledSolve();
+  testDestroyingWhileSolving();
+}
@@ -0,0 +1,34 @@
+#include "coalescedcall.hpp"
+
+
+CoalescedCall::CoalescedCall(
+  ScheduleFunction schedule_function_arg,
+  Function function_arg
+)
+: schedule_function(std::move(schedule_function_arg)),
+  function(std::move(function_arg))
+{
+}
+
+
+void CoalescedCall::request()
+{
+  if (is_pending) {
+    return;
+  }
+
+  is_pending = true;
+  schedule_function([this]{ flush(); });
+}
+
+
+void CoalescedCall::flush()
+{
+  if (!is_pending) {
+    return;
+  }
+
+  // The function may request another call.
+  is_pending = false;
+  function();
+}
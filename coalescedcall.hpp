@@ -0,0 +1,33 @@
+#ifndef COALESCEDCALL_HPP_
+#define COALESCEDCALL_HPP_
+
+#include <functional>
+
+
+// Calls a function once for any number of requests that are made before
+// it gets to run, so that a burst of events, such as the motion events of
+// a drag that arrive during a single frame, is handled once using the
+// latest state.  The schedule function arranges for the function it is
+// given to be called later, and this must outlive that call.
+class CoalescedCall {
+  public:
+    using Function = std::function<void()>;
+    using ScheduleFunction = std::function<void(Function)>;
+
+    CoalescedCall(ScheduleFunction, Function);
+
+    // Schedules the call unless it is already scheduled.
+    void request();
+
+    // Makes the call now if it has been requested and hasn't been made yet.
+    void flush();
+
+    bool isPending() const { return is_pending; }
+
+  private:
+    const ScheduleFunction schedule_function;
+    const Function function;
+    bool is_pending = false;
+};
+
+#endif /* COALESCEDCALL_HPP_ */
@@ -0,0 +1,69 @@
+#include "coalescedcall.hpp"
+
+#include <cassert>
+#include "vector.hpp"
+
+using Function = CoalescedCall::Function;
+
+
+namespace {
+struct Tester {
+  vector<Function> scheduled_functions;
+  int n_calls = 0;
+
+  CoalescedCall call{
+    [this](Function f){ scheduled_functions.push_back(std::move(f)); },
+    [this]{ ++n_calls; }
+  };
+
+  void runScheduledFunctions()
+  {
+    vector<Function> functions;
+    functions.swap(scheduled_functions);
+
+    for (const Function &f : functions) {
+      f();
+    }
+  }
+};
+}
+
+
+static void testCoalescingRequests()
+{
+  Tester tester;
+  tester.call.request();
+  tester.call.request();
+  tester.call.request();
+  assert(tester.n_calls == 0);
+  assert(tester.call.isPending());
+  assert(tester.scheduled_functions.size() == 1);
+  tester.runScheduledFunctions();
+  assert(tester.n_calls == 1);
+  assert(!tester.call.isPending());
+  tester.call.request();
+  tester.runScheduledFunctions();
+  assert(tester.n_calls == 2);
+}
+
+
+static void testFlushing()
+{
+  Tester tester;
+  tester.call.flush();
+  assert(tester.n_calls == 0);
+  tester.call.request();
+  tester.call.flush();
+  assert(tester.n_calls == 1);
+
+  // The scheduled call was already made.
+  tester.runScheduledFunctions();
+  assert(tester.n_calls == 1);
+}
+
+
+int main()
+{
+  testCoalescingRequests();
+  testFlushing();
+}
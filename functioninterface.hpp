@@ -1,9 +1,26 @@
 #ifndef FUNCTIONINTERFACE_HPP_
 #define FUNCTIONINTERFACE_HPP_
 
+#include <cstddef>
+
 
 struct FunctionInterface {
   virtual float operator()() const = 0;
+
+  // This may be overridden to evaluate the function more efficiently when
+  // the only variables that have changed since the previous evaluation are
+  // the given one and the one given in the previous call, if any.
+  virtual float operator()(size_t /*changed_variable_index*/) const
+  {
+    return operator()();
+  }
+
+  // Called after each pass over the variables.
+  virtual void iterationFinished(float /*error*/) const {}
+
+  // Checked as the variables are optimized.  If it returns true, the
+  // minimization stops and the variables keep their best values so far.
+  virtual bool shouldStop() const { return false; }
 };
 
 
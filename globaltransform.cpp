@@ -5,6 +5,9 @@
 #include "positionstate.hpp"
 #include "sceneobjects.hpp"
 #include "scenetransform.hpp"
+#include "rotationvector.hpp"
+#include "vec3state.hpp"
+#include "indicesof.hpp"
 
 
 Transform
@@ -103,3 +106,247 @@ bodyMeshPositionPredicted(
       scene_state
     );
 }
+
+
+GlobalTransformCache::GlobalTransformCache(const SceneState &scene_state_arg)
+: scene_state(scene_state_arg),
+  children(scene_state_arg.bodies().size()),
+  transforms(scene_state_arg.bodies().size()),
+  rotations(scene_state_arg.bodies().size()),
+  is_valid(scene_state_arg.bodies().size(), false)
+{
+  for (auto body_index : indicesOf(scene_state.bodies())) {
+    Optional<BodyIndex> maybe_parent_index =
+      scene_state.body(body_index).maybe_parent_index;
+
+    if (maybe_parent_index) {
+      children[*maybe_parent_index].push_back(body_index);
+    }
+  }
+}
+
+
+// The parent is always computed before the child, so a valid body always
+// has valid ancestors, and an invalid body always has invalid descendants.
+const Transform &
+  GlobalTransformCache::scaledGlobalTransform(BodyIndex body_index)
+{
+  if (!is_valid[body_index]) {
+    const SceneState::Body &body_state = scene_state.body(body_index);
+    const TransformState &transform_state = body_state.transform;
+
+    const Eigen::Matrix3f &rotation =
+      rotations[body_index].update(rotationValuesDeg(transform_state));
+
+    Transform local;
+    local.linear() = rotation*transform_state.scale;
+    local.translation() = eigenVector3f(translationValues(transform_state));
+
+    if (body_state.maybe_parent_index) {
+      transforms[body_index] =
+        scaledGlobalTransform(*body_state.maybe_parent_index) * local;
+    }
+    else {
+      transforms[body_index] = local;
+    }
+
+    is_valid[body_index] = true;
+  }
+
+  return transforms[body_index];
+}
+
+
+const Eigen::Matrix3f &GlobalTransformCache::rotation(BodyIndex body_index)
+{
+  scaledGlobalTransform(body_index);
+  return rotations[body_index].matrix;
+}
+
+
+const Eigen::Matrix3f &
+  GlobalTransformCache::rotationJacobian(BodyIndex body_index)
+{
+  scaledGlobalTransform(body_index);
+  return rotations[body_index].vectorJacobian();
+}
+
+
+void GlobalTransformCache::invalidateBody(BodyIndex body_index)
+{
+  if (!is_valid[body_index]) {
+    return;
+  }
+
+  is_valid[body_index] = false;
+
+  for (BodyIndex child_index : children[body_index]) {
+    invalidateBody(child_index);
+  }
+}
+
+
+void GlobalTransformCache::computeAll()
+{
+  for (auto body_index : indicesOf(is_valid)) {
+    scaledGlobalTransform(body_index);
+  }
+}
+
+
+static Point
+  cachedPointRelativeToScene(
+    const Point &local,
+    Optional<BodyIndex> maybe_body_index,
+    GlobalTransformCache &cache
+  )
+{
+  if (!maybe_body_index) {
+    return local;
+  }
+
+  return cache.scaledGlobalTransform(*maybe_body_index) * local;
+}
+
+
+Point
+  markerPredicted(
+    const SceneState &scene_state,
+    MarkerIndex marker_index,
+    GlobalTransformCache &cache
+  )
+{
+  const SceneState::Marker &marker = scene_state.marker(marker_index);
+
+  return
+    cachedPointRelativeToScene(
+      makePointFromPositionState(marker.position),
+      marker.maybe_body_index,
+      cache
+    );
+}
+
+
+Point
+  bodyMeshPositionPredicted(
+    const SceneState &scene_state,
+    BodyMeshPosition body_mesh_position,
+    GlobalTransformCache &cache
+  )
+{
+  Vec3 local = bodyMeshPositionRelativeToBody(body_mesh_position, scene_state);
+
+  return
+    cachedPointRelativeToScene(
+      makePointFromScenePoint(local),
+      body_mesh_position.array.body_mesh.body.index,
+      cache
+    );
+}
+
+
+static Point
+globalPointWithDerivatives(
+  const Point &local,
+  Optional<BodyIndex> maybe_body_index,
+  const SceneState &scene_state,
+  GlobalTransformCache &cache,
+  vector<BodyTransformDerivatives> &derivatives
+)
+{
+  Point p = local;
+
+  // Going up the hierarchy, find the derivatives in the coordinate system
+  // of each body's parent, and convert them to the global coordinate
+  // system using the parent's global transform.
+  while (maybe_body_index) {
+    BodyIndex body_index = *maybe_body_index;
+    const SceneState::Body &body_state = scene_state.body(body_index);
+    const TransformState &transform_state = body_state.transform;
+    const Eigen::Matrix3f &rotation = cache.rotation(body_index);
+    float scale = transform_state.scale;
+    Point rotated = rotation*p;
+    Point scaled = rotated*scale;
+    Eigen::Matrix3f parent_linear = Eigen::Matrix3f::Identity();
+
+    if (body_state.maybe_parent_index) {
+      parent_linear =
+        cache.scaledGlobalTransform(*body_state.maybe_parent_index).linear();
+    }
+
+    BodyTransformDerivatives body_derivatives;
+    body_derivatives.body_index = body_index;
+    body_derivatives.translation = parent_linear;
+
+    body_derivatives.rotation =
+      -parent_linear*crossProductMatrix(scaled)*
+      cache.rotationJacobian(body_index);
+
+    body_derivatives.scale = parent_linear*rotated;
+    derivatives.push_back(body_derivatives);
+    p = scaled + point(transform_state.translation);
+    maybe_body_index = body_state.maybe_parent_index;
+  }
+
+  return p;
+}
+
+
+Point
+markerPredictedWithDerivatives(
+  const SceneState &scene_state,
+  MarkerIndex marker_index,
+  GlobalTransformCache &cache,
+  vector<BodyTransformDerivatives> &derivatives
+)
+{
+  const SceneState::Marker &marker = scene_state.marker(marker_index);
+  Point local = makePointFromPositionState(marker.position);
+
+  return
+    globalPointWithDerivatives(
+      local, marker.maybe_body_index, scene_state, cache, derivatives
+    );
+}
+
+
+Point
+bodyMeshPositionPredictedWithDerivatives(
+  const SceneState &scene_state,
+  BodyMeshPosition body_mesh_position,
+  GlobalTransformCache &cache,
+  vector<BodyTransformDerivatives> &derivatives
+)
+{
+  Vec3 local = bodyMeshPositionRelativeToBody(body_mesh_position, scene_state);
+
+  return
+    globalPointWithDerivatives(
+      makePointFromScenePoint(local),
+      body_mesh_position.array.body_mesh.body.index,
+      scene_state,
+      cache,
+      derivatives
+    );
+}
+
+
+Eigen::Matrix3f
+bodyMeshPositionScaleDerivatives(
+  const SceneState &scene_state,
+  BodyMeshPosition body_mesh_position,
+  GlobalTransformCache &cache
+)
+{
+  BodyIndex body_index = body_mesh_position.array.body_mesh.body.index;
+  MeshIndex mesh_index = body_mesh_position.array.body_mesh.index;
+
+  const SceneState::XYZ &position =
+    scene_state.body(body_index).meshes[mesh_index]
+    .shape.positions[body_mesh_position.index];
+
+  const Eigen::Matrix3f &linear =
+    cache.scaledGlobalTransform(body_index).linear();
+
+  return linear*point(position).asDiagonal();
+}
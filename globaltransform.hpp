@@ -1,6 +1,10 @@
+#ifndef GLOBALTRANSFORM_HPP_
+#define GLOBALTRANSFORM_HPP_
+
 #include "point.hpp"
 #include "transform.hpp"
 #include "scenestate.hpp"
+#include "rotationvector.hpp"
 
 
 // This transform a point from a body's coordinate system to the parent's
@@ -26,6 +30,98 @@ extern Point
 extern Point
   bodyMeshPositionPredicted(const SceneState &scene_state, BodyMeshPosition);
 
+
+// Keeps the scaled global transform of each body once it has been computed,
+// so that points on the same body, or on bodies with common ancestors,
+// don't need to recompute the transforms of the whole chain.  The body
+// hierarchy must not change while the cache is being used, and
+// invalidateBody() must be called whenever a body's transform changes, so
+// that a cache can be kept across evaluations where only some bodies move.
+// Each body's rotation matrix is kept separately, so recomputing a body
+// whose rotation didn't change only needs to redo the translation and
+// scale, and the derivative functions can share it.
+class GlobalTransformCache {
+  public:
+    GlobalTransformCache(const SceneState &);
+
+    const Transform &scaledGlobalTransform(BodyIndex);
+
+    // The body's local rotation, and the rotationVectorJacobian() of its
+    // rotation vector.
+    const Eigen::Matrix3f &rotation(BodyIndex);
+    const Eigen::Matrix3f &rotationJacobian(BodyIndex);
+
+    // This also invalidates the body's descendants.
+    void invalidateBody(BodyIndex);
+
+    // Makes sure every body's transform has been computed.
+    void computeAll();
+
+  private:
+    const SceneState &scene_state;
+    vector<vector<BodyIndex>> children;
+    vector<Transform, Eigen::aligned_allocator<Transform>> transforms;
+    vector<CachedRotation> rotations;
+    vector<bool> is_valid;
+};
+
+
+extern Point
+  markerPredicted(
+    const SceneState &,
+    MarkerIndex,
+    GlobalTransformCache &
+  );
+
+extern Point
+  bodyMeshPositionPredicted(
+    const SceneState &,
+    BodyMeshPosition,
+    GlobalTransformCache &
+  );
+
+
+// Derivatives of a global point with respect to the transform values of one
+// of the bodies that the point is attached to.  The columns of the
+// translation and rotation matrices are for the x, y, and z components, and
+// the rotation derivatives are per radian.
+struct BodyTransformDerivatives {
+  BodyIndex body_index;
+  Eigen::Matrix3f translation;
+  Eigen::Matrix3f rotation;
+  Eigen::Vector3f scale;
+};
+
+
+// These return the predicted global position and append the derivatives of
+// that position for the point's body and each of its ancestors.  The
+// cache must be up to date with the scene state.
+
+extern Point
+  markerPredictedWithDerivatives(
+    const SceneState &,
+    MarkerIndex,
+    GlobalTransformCache &,
+    vector<BodyTransformDerivatives> &
+  );
+
+extern Point
+  bodyMeshPositionPredictedWithDerivatives(
+    const SceneState &,
+    BodyMeshPosition,
+    GlobalTransformCache &,
+    vector<BodyTransformDerivatives> &
+  );
+
+// The columns are the derivatives of the global position with respect to
+// the x, y, and z mesh scale.
+extern Eigen::Matrix3f
+  bodyMeshPositionScaleDerivatives(
+    const SceneState &,
+    BodyMeshPosition,
+    GlobalTransformCache &
+  );
+
 extern Transform
   unscaledGlobalTransform(
     Optional<BodyIndex> maybe_body_index,
@@ -49,3 +145,5 @@ scaledGlobalTransform(
 
   return transform;
 }
+
+#endif /* GLOBALTRANSFORM_HPP_ */
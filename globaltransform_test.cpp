@@ -107,9 +107,169 @@ static void testGlobalTransform()
 }
 
 
+template <typename Function>
+static Point
+  numericalDerivative(float &value, float delta, const Function &f)
+{
+  float old_value = value;
+  value = old_value + delta;
+  Point forward = f();
+  value = old_value - delta;
+  Point reverse = f();
+  value = old_value;
+  return (forward - reverse)/(2*delta);
+}
+
+
+static void testMarkerDerivatives()
+{
+  RandomEngine engine(/*seed*/1);
+  SceneState scene_state;
+  BodyIndex body1_index = scene_state.createBody();
+  BodyIndex body2_index = scene_state.createBody(body1_index);
+  BodyIndex body3_index = scene_state.createBody(body2_index);
+
+  for (BodyIndex body_index : {body1_index, body2_index, body3_index}) {
+    TransformState &transform_state = scene_state.body(body_index).transform;
+    transform_state = randomUnscaledTransformState(engine);
+    transform_state.rotation.x *= 30;
+    transform_state.rotation.y *= 30;
+    transform_state.rotation.z *= 30;
+    transform_state.scale = randomFloat(0.5, 2, engine);
+  }
+
+  MarkerIndex marker_index = scene_state.createMarker(body3_index);
+
+  scene_state.marker(marker_index).position =
+    makePositionStateFromVec3(randomVec3(engine));
+
+  vector<BodyTransformDerivatives> derivatives;
+  GlobalTransformCache cache(scene_state);
+
+  Point p =
+    markerPredictedWithDerivatives(
+      scene_state, marker_index, cache, derivatives
+    );
+
+  assertNear(p, markerPredicted(scene_state, marker_index), 1e-5);
+  assert(derivatives.size() == 3);
+
+  auto f = [&]{ return markerPredicted(scene_state, marker_index); };
+  float tolerance = 0.01;
+
+  for (const BodyTransformDerivatives &body_derivatives : derivatives) {
+    TransformState &transform_state =
+      scene_state.body(body_derivatives.body_index).transform;
+
+    for (int i = 0; i != 3; ++i) {
+      XYZComponent c = XYZComponent(i);
+
+      assertNear(
+        numericalDerivative(
+          component(transform_state.translation, c), 1e-2, f
+        ),
+        body_derivatives.translation.col(i),
+        tolerance
+      );
+
+      float rotation_delta = 0.1;
+
+      assertNear(
+        numericalDerivative(
+          component(transform_state.rotation, c), rotation_delta, f
+        )*(180/M_PI),
+        body_derivatives.rotation.col(i),
+        tolerance
+      );
+    }
+
+    assertNear(
+      numericalDerivative(transform_state.scale, 1e-2, f),
+      body_derivatives.scale,
+      tolerance
+    );
+  }
+}
+
+
+static void testGlobalTransformCache()
+{
+  RandomEngine engine(/*seed*/1);
+  SceneState scene_state;
+  BodyIndex body1_index = scene_state.createBody();
+  BodyIndex body2_index = scene_state.createBody(body1_index);
+  BodyIndex body3_index = scene_state.createBody();
+
+  for (BodyIndex body_index : {body1_index, body2_index, body3_index}) {
+    scene_state.body(body_index).transform =
+      randomUnscaledTransformState(engine);
+  }
+
+  MarkerIndex marker2_index = scene_state.createMarker(body2_index);
+  MarkerIndex marker3_index = scene_state.createMarker(body3_index);
+
+  for (MarkerIndex marker_index : {marker2_index, marker3_index}) {
+    scene_state.marker(marker_index).position =
+      makePositionStateFromVec3(randomVec3(engine));
+  }
+
+  GlobalTransformCache cache(scene_state);
+
+  auto check = [&]{
+    for (MarkerIndex marker_index : {marker2_index, marker3_index}) {
+      assertNear(
+        markerPredicted(scene_state, marker_index, cache),
+        markerPredicted(scene_state, marker_index),
+        1e-5
+      );
+    }
+  };
+
+  check();
+
+  // Changing the parent must also update the child.
+  scene_state.body(body1_index).transform.translation.x += 1;
+  scene_state.body(body1_index).transform.scale = 2;
+  cache.invalidateBody(body1_index);
+  check();
+
+  // Bodies outside the invalidated subtree keep their cached transform.
+  Transform old_body3_transform = cache.scaledGlobalTransform(body3_index);
+  scene_state.body(body3_index).transform.translation.x += 1;
+  cache.invalidateBody(body2_index);
+  assert(cache.scaledGlobalTransform(body3_index).isApprox(old_body3_transform));
+  cache.invalidateBody(body3_index);
+  check();
+
+  auto check_rotation_jacobian = [&]{
+    const TransformState &transform_state =
+      scene_state.body(body2_index).transform;
+
+    Eigen::Matrix3f expected =
+      rotationVectorJacobian(rotationValuesDeg(transform_state)*(M_PI/180));
+
+    assert(cache.rotationJacobian(body2_index).isApprox(expected));
+  };
+
+  check_rotation_jacobian();
+
+  // The rotation matrix and its jacobian are only remade when the rotation
+  // changes.
+  scene_state.body(body2_index).transform.rotation.y += 10;
+  cache.invalidateBody(body2_index);
+  check();
+  check_rotation_jacobian();
+  scene_state.body(body2_index).transform.translation.z += 1;
+  cache.invalidateBody(body2_index);
+  check();
+}
+
+
 int main()
 {
   testWithGlobalMarkerAtOrigin();
   testWithHierarchy();
   testGlobalTransform();
+  testMarkerDerivatives();
+  testGlobalTransformCache();
 }
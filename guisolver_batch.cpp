@@ -0,0 +1,411 @@
+// Solves scene files without the GUI, the same way that they are solved
+// when they are opened, and saves the solved scenes.
+//
+//   guisolver_batch [-o output_dir] [-j n_threads] [-s n_starts] scene.scn...
+//
+// Each solved scene is written to output_dir with the same file name, or
+// next to the original as name.solved.scn if no output directory is given.
+// The scenes are solved concurrently, and a summary with a row for each
+// scene is printed once they are all done, with the final errors that are
+// higher than the initial errors marked.  The exit status is nonzero if
+// any scene couldn't be read or written.
+//
+// With -s, each scene is solved from that many starts, as described in
+// multistart.hpp, and the one with the lowest error is kept.  The scenes
+// are then solved one at a time, with their starts solved concurrently.
+//
+//   guisolver_batch -f frames.txt [-c n_chunks] [-o output_dir] scene.scn
+//
+// Solves the scene for each frame of marker positions in frames.txt, as
+// described in markerframes.hpp, and writes the solved values of each
+// frame to frames.solved.txt.  With more than one chunk, runs of frames
+// are solved concurrently.
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+#include <string>
+#include <sstream>
+#include "scenestateio.hpp"
+#include "scenesolver.hpp"
+#include "sceneerror.hpp"
+#include "threadpool.hpp"
+#include "markerframes.hpp"
+#include "multistart.hpp"
+
+using std::cout;
+using std::cerr;
+using std::string;
+
+
+namespace {
+struct BatchArgs {
+  Optional<string> maybe_output_dir;
+  size_t n_threads = ThreadPool::defaultThreadCount();
+  vector<string> input_paths;
+  Optional<string> maybe_frames_path;
+  size_t n_chunks = 1;
+  size_t n_starts = 1;
+};
+}
+
+
+namespace {
+struct BatchResult {
+  Optional<string> maybe_error_message;
+  SolveStats stats;
+  float initial_error = 0;
+  float final_error = 0;
+  double seconds = 0;
+};
+}
+
+
+static string baseName(const string &path)
+{
+  string::size_type slash_index = path.rfind('/');
+
+  if (slash_index == string::npos) {
+    return path;
+  }
+
+  return path.substr(slash_index + 1);
+}
+
+
+static string
+  outputPath(const string &input_path, const Optional<string> &maybe_dir)
+{
+  if (maybe_dir) {
+    return *maybe_dir + "/" + baseName(input_path);
+  }
+
+  string name = baseName(input_path);
+  string::size_type dot_index = name.rfind('.');
+
+  if (dot_index == string::npos || dot_index == 0) {
+    return input_path + ".solved";
+  }
+
+  string::size_type n_extension = name.size() - dot_index;
+  string::size_type extension_index = input_path.size() - n_extension;
+
+  return
+    input_path.substr(0, extension_index) + ".solved" +
+    input_path.substr(extension_index);
+}
+
+
+static Optional<size_t> maybeCount(const char *arg)
+{
+  std::istringstream stream(arg);
+  int n = 0;
+  stream >> n;
+
+  if (!stream || n < 1) {
+    return {};
+  }
+
+  return size_t(n);
+}
+
+
+static Optional<BatchArgs> parseArgs(int argc, char **argv)
+{
+  BatchArgs result;
+
+  for (int i = 1; i != argc; ++i) {
+    string arg = argv[i];
+
+    if (arg == "-o" && i + 1 != argc) {
+      result.maybe_output_dir = string(argv[++i]);
+    }
+    else if (arg == "-j" && i + 1 != argc) {
+      Optional<size_t> maybe_n_threads = maybeCount(argv[++i]);
+
+      if (!maybe_n_threads) {
+        return {};
+      }
+
+      result.n_threads = *maybe_n_threads;
+    }
+    else if (arg == "-c" && i + 1 != argc) {
+      Optional<size_t> maybe_n_chunks = maybeCount(argv[++i]);
+
+      if (!maybe_n_chunks) {
+        return {};
+      }
+
+      result.n_chunks = *maybe_n_chunks;
+    }
+    else if (arg == "-s" && i + 1 != argc) {
+      Optional<size_t> maybe_n_starts = maybeCount(argv[++i]);
+
+      if (!maybe_n_starts) {
+        return {};
+      }
+
+      result.n_starts = *maybe_n_starts;
+    }
+    else if (arg == "-f" && i + 1 != argc) {
+      result.maybe_frames_path = string(argv[++i]);
+    }
+    else if (!arg.empty() && arg[0] == '-') {
+      return {};
+    }
+    else {
+      result.input_paths.push_back(arg);
+    }
+  }
+
+  if (result.input_paths.empty()) {
+    return {};
+  }
+
+  if (result.maybe_frames_path && result.input_paths.size() != 1) {
+    return {};
+  }
+
+  return result;
+}
+
+
+static double secondsSince(std::chrono::steady_clock::time_point start_time)
+{
+  return
+    std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start_time
+    ).count();
+}
+
+
+static Expected<SceneState> readScene(const string &path)
+{
+  std::ifstream stream(path);
+
+  if (!stream) {
+    return Error{"Unable to open " + path};
+  }
+
+  return scanSceneStateFrom(stream);
+}
+
+
+// The scene is solved with the default options, as when it is opened in
+// the GUI.  Nested solves don't use the pool, since it is busy with the
+// other scenes, unless there are multiple starts, which the pool solves
+// concurrently instead.
+static void
+  solveFile(
+    const string &input_path,
+    const string &output_path,
+    size_t n_starts,
+    ThreadPool &thread_pool,
+    BatchResult &result
+  )
+{
+  auto start_time = std::chrono::steady_clock::now();
+  Expected<SceneState> expected_scene_state = readScene(input_path);
+
+  if (expected_scene_state.isError()) {
+    result.maybe_error_message = expected_scene_state.asError().message;
+    return;
+  }
+
+  SceneState scene_state = expected_scene_state.asValue();
+  updateErrorsInState(scene_state);
+  result.initial_error = sceneError(scene_state);
+
+  if (n_starts > 1) {
+    MultiStartSolveOptions options;
+    options.n_starts = n_starts;
+    options.thread_pool_ptr = &thread_pool;
+    result.stats = solveSceneFromMultipleStarts(scene_state, options).stats;
+  }
+  else {
+    result.stats = solveScene(scene_state);
+  }
+
+  result.final_error = sceneError(scene_state);
+  std::ofstream output_stream(output_path);
+  printSceneStateOn(output_stream, scene_state);
+
+  if (!output_stream) {
+    result.maybe_error_message = "Unable to write " + output_path;
+  }
+
+  result.seconds = secondsSince(start_time);
+}
+
+
+static void
+  printRow(
+    const string &path,
+    const string &n_variables,
+    const string &n_evaluations,
+    const string &initial_error,
+    const string &final_error,
+    const string &time_ms
+  )
+{
+  cout << std::left << std::setw(40) << path;
+  cout << std::right;
+  cout << std::setw(10) << n_variables;
+  cout << std::setw(12) << n_evaluations;
+  cout << std::setw(14) << initial_error;
+  cout << std::setw(14) << final_error;
+  cout << std::setw(12) << time_ms;
+  cout << "\n";
+}
+
+
+static string str(double value)
+{
+  std::ostringstream stream;
+  stream << value;
+  return stream.str();
+}
+
+
+static int solveFrames(const BatchArgs &args)
+{
+  const string &scene_path = args.input_paths[0];
+  const string &frames_path = *args.maybe_frames_path;
+  Expected<SceneState> expected_scene_state = readScene(scene_path);
+
+  if (expected_scene_state.isError()) {
+    cerr << scene_path << ": " << expected_scene_state.asError().message;
+    cerr << "\n";
+    return 1;
+  }
+
+  const SceneState &scene_state = expected_scene_state.asValue();
+  std::ifstream frames_stream(frames_path);
+
+  if (!frames_stream) {
+    cerr << "Unable to open " << frames_path << "\n";
+    return 1;
+  }
+
+  Expected<MarkerFrames> expected_frames =
+    scanMarkerFramesFrom(frames_stream, scene_state);
+
+  if (expected_frames.isError()) {
+    cerr << frames_path << ": " << expected_frames.asError().message << "\n";
+    return 1;
+  }
+
+  const MarkerFrames &marker_frames = expected_frames.asValue();
+  ThreadPool thread_pool(args.n_threads);
+  MarkerFramesSolveOptions options;
+  options.n_chunks = args.n_chunks;
+  options.thread_pool_ptr = &thread_pool;
+  auto start_time = std::chrono::steady_clock::now();
+
+  SolvedFrames solved_frames =
+    solveMarkerFrames(scene_state, marker_frames, options);
+
+  double seconds = secondsSince(start_time);
+  string output_path = outputPath(frames_path, args.maybe_output_dir);
+  std::ofstream output_stream(output_path);
+  printSolvedFramesOn(output_stream, solved_frames);
+
+  if (!output_stream) {
+    cerr << "Unable to write " << output_path << "\n";
+    return 1;
+  }
+
+  size_t n_frames = marker_frames.frame_values.size();
+  cout << n_frames << " frames solved in " << seconds*1000 << "ms";
+  cout << " (" << n_frames/seconds << " frames per second)\n";
+  return 0;
+}
+
+
+int main(int argc, char **argv)
+{
+  Optional<BatchArgs> maybe_args = parseArgs(argc, argv);
+
+  if (!maybe_args) {
+    cerr <<
+      "Usage: " << argv[0] <<
+      " [-o output_dir] [-j n_threads] [-s n_starts] scene.scn...\n" <<
+      "       " << argv[0] <<
+      " -f frames.txt [-c n_chunks] [-o output_dir] scene.scn\n";
+    return 2;
+  }
+
+  const BatchArgs &args = *maybe_args;
+
+  if (args.maybe_frames_path) {
+    return solveFrames(args);
+  }
+
+  size_t n_files = args.input_paths.size();
+  vector<BatchResult> results(n_files);
+  ThreadPool thread_pool(args.n_threads);
+  auto start_time = std::chrono::steady_clock::now();
+
+  auto solve_file = [&](size_t index, size_t){
+    const string &input_path = args.input_paths[index];
+
+    solveFile(
+      input_path, outputPath(input_path, args.maybe_output_dir),
+      args.n_starts, thread_pool, results[index]
+    );
+  };
+
+  if (args.n_starts > 1) {
+    for (size_t index = 0; index != n_files; ++index) {
+      solve_file(index, /*thread_index*/0);
+    }
+  }
+  else {
+    thread_pool.forEachIndex(n_files, solve_file);
+  }
+
+  double total_seconds = secondsSince(start_time);
+
+  printRow(
+    "scene", "variables", "evals", "initial_error", "final_error", "time(ms)"
+  );
+
+  int n_failed = 0;
+  int n_worse = 0;
+
+  for (size_t index = 0; index != n_files; ++index) {
+    const string &input_path = args.input_paths[index];
+    const BatchResult &result = results[index];
+
+    if (result.maybe_error_message) {
+      cerr << input_path << ": " << *result.maybe_error_message << "\n";
+      ++n_failed;
+      continue;
+    }
+
+    string final_error = str(result.final_error);
+
+    if (result.final_error > result.initial_error) {
+      final_error += "*";
+      ++n_worse;
+    }
+
+    printRow(
+      input_path,
+      str(result.stats.n_variables),
+      str(result.stats.n_evaluations),
+      str(result.initial_error),
+      final_error,
+      str(result.seconds*1000)
+    );
+  }
+
+  if (n_worse != 0) {
+    cout << "* The final error is higher than the initial error.\n";
+  }
+
+  cout << n_files - n_failed << " of " << n_files << " scenes solved in ";
+  cout << total_seconds*1000 << "ms\n";
+  return (n_failed == 0) ? 0 : 1;
+}
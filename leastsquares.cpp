@@ -0,0 +1,271 @@
+#include "leastsquares.hpp"
+
+#include <algorithm>
+#include <Eigen/SparseCholesky>
+
+using Eigen::VectorXf;
+using Eigen::MatrixXf;
+using Eigen::VectorXd;
+using Eigen::MatrixXd;
+using SparseMatrixd = Eigen::SparseMatrix<double>;
+
+static const int max_iterations = 100;
+static const double initial_damping = 1e-3;
+static const double min_damping = 1e-9;
+static const double max_damping = 1e10;
+
+// Variables that don't affect any residual would otherwise make the damped
+// normal equations singular.
+static const double min_diagonal = 1e-6;
+
+// We're converged when the step is this small relative to the variables,
+// or the error decreases by less than this fraction.
+static const float min_relative_step = 1e-6;
+static const float min_relative_decrease = 1e-6;
+
+
+static float maxMagnitude(const vector<float> &values)
+{
+  float result = 0;
+
+  for (float value : values) {
+    result = std::max(result, std::abs(value));
+  }
+
+  return result;
+}
+
+
+// The normal equations are solved in double precision since forming them
+// squares the condition number.
+namespace {
+struct DenseNormalEquations {
+  MatrixXd normal;
+  VectorXd gradient;
+
+  void set(const MatrixXf &jacobian, const VectorXf &residuals)
+  {
+    MatrixXd jacobian_d = jacobian.cast<double>();
+    normal = jacobian_d.transpose()*jacobian_d;
+    gradient = jacobian_d.transpose()*residuals.cast<double>();
+  }
+
+  bool dampedStep(double damping, VectorXd &step)
+  {
+    MatrixXd damped = normal;
+
+    for (Eigen::Index i = 0; i != damped.rows(); ++i) {
+      damped(i,i) += damping*std::max(normal(i,i), min_diagonal);
+    }
+
+    step = -damped.ldlt().solve(gradient);
+    return true;
+  }
+};
+}
+
+
+// With fewer residuals than variables, as with a chain of joints reaching
+// for a few targets, the damped step -(J'*J + d*I)^-1*J'*r is computed as
+// the equal -J'*(J*J' + d*I)^-1*r, which only needs equations the size of
+// the residuals.  The damping is the same for every variable, relative to
+// the average diagonal of J*J'.
+namespace {
+struct UnderdeterminedEquations {
+  MatrixXd jacobian;
+  MatrixXd product;
+  VectorXd residuals;
+  VectorXd gradient;
+  double damping_scale = 0;
+
+  void set(const MatrixXf &jacobian_arg, const VectorXf &residuals_arg)
+  {
+    jacobian = jacobian_arg.cast<double>();
+    residuals = residuals_arg.cast<double>();
+    product = jacobian*jacobian.transpose();
+    gradient = jacobian.transpose()*residuals;
+
+    damping_scale =
+      (product.rows() == 0) ? min_diagonal
+      : std::max(product.diagonal().mean(), min_diagonal);
+  }
+
+  bool dampedStep(double damping, VectorXd &step)
+  {
+    MatrixXd damped = product;
+    damped.diagonal().array() += damping*damping_scale;
+    step = -jacobian.transpose()*damped.ldlt().solve(residuals);
+    return true;
+  }
+};
+}
+
+
+// The sparsity pattern of the damped normal equations doesn't depend on the
+// damping, so it is only analyzed once per jacobian.
+namespace {
+struct SparseNormalEquations {
+  SparseMatrixd normal;
+  VectorXd gradient;
+  VectorXd diagonal;
+  SparseMatrixd damped;
+  Eigen::SimplicialLDLT<SparseMatrixd> solver;
+  bool pattern_is_analyzed = false;
+
+  void
+    set(const Eigen::SparseMatrix<float> &jacobian, const VectorXf &residuals)
+  {
+    SparseMatrixd jacobian_d = jacobian.cast<double>();
+    normal = SparseMatrixd(jacobian_d.transpose())*jacobian_d;
+    gradient = jacobian_d.transpose()*residuals.cast<double>();
+
+    // Make sure the diagonal is part of the pattern, even for variables
+    // that don't affect any residuals.
+    for (Eigen::Index i = 0; i != normal.rows(); ++i) {
+      normal.coeffRef(i,i) += 0;
+    }
+
+    normal.makeCompressed();
+    diagonal = normal.diagonal().cwiseMax(min_diagonal);
+    pattern_is_analyzed = false;
+  }
+
+  bool dampedStep(double damping, VectorXd &step)
+  {
+    damped = normal;
+
+    for (Eigen::Index i = 0; i != damped.rows(); ++i) {
+      damped.coeffRef(i,i) += damping*diagonal[i];
+    }
+
+    if (!pattern_is_analyzed) {
+      solver.analyzePattern(damped);
+      pattern_is_analyzed = true;
+    }
+
+    solver.factorize(damped);
+
+    if (solver.info() != Eigen::Success) {
+      return false;
+    }
+
+    step = -solver.solve(gradient);
+    return true;
+  }
+};
+}
+
+
+template <typename Jacobian, typename NormalEquations, typename Function>
+static float minimizeWith(const Function &f, vector<float> &variables)
+{
+  size_t n_variables = variables.size();
+  VectorXf residuals;
+  Jacobian jacobian;
+  f(residuals, &jacobian);
+  float error = residuals.squaredNorm();
+
+  if (n_variables == 0) {
+    return error;
+  }
+
+  double damping = initial_damping;
+  vector<float> old_variables;
+  VectorXf new_residuals;
+  NormalEquations normal_equations;
+  VectorXd step;
+
+  for (int iteration = 0; iteration != max_iterations; ++iteration) {
+    if (error == 0) {
+      break;
+    }
+
+    normal_equations.set(jacobian, residuals);
+
+    if (normal_equations.gradient.template lpNorm<Eigen::Infinity>() == 0) {
+      break;
+    }
+
+    float max_step = 0;
+    float old_error = error;
+
+    for (;;) {
+      if (normal_equations.dampedStep(damping, step)) {
+        old_variables = variables;
+        max_step = 0;
+
+        for (size_t i = 0; i != n_variables; ++i) {
+          variables[i] += step[i];
+          max_step = std::max(max_step, float(std::abs(step[i])));
+        }
+
+        f(new_residuals, nullptr);
+        float new_error = new_residuals.squaredNorm();
+
+        if (new_error < error) {
+          error = new_error;
+          damping = std::max(damping/10, min_damping);
+          f.iterationFinished(error);
+          break;
+        }
+
+        variables = old_variables;
+      }
+
+      damping *= 10;
+
+      if (damping > max_damping) {
+        // No step in the downhill direction reduces the error, so we are
+        // at the minimum within the precision we have.
+        return error;
+      }
+    }
+
+    if (f.shouldStop()) {
+      break;
+    }
+
+    if (max_step <= min_relative_step*(maxMagnitude(variables) + 1)) {
+      break;
+    }
+
+    if (old_error - error <= min_relative_decrease*old_error) {
+      break;
+    }
+
+    f(residuals, &jacobian);
+  }
+
+  return error;
+}
+
+
+float
+  minimizeLeastSquaresImpl(
+    const LeastSquaresInterface &f,
+    vector<float> &variables
+  )
+{
+  return minimizeWith<MatrixXf, DenseNormalEquations>(f, variables);
+}
+
+
+float
+  minimizeUnderdeterminedLeastSquaresImpl(
+    const LeastSquaresInterface &f,
+    vector<float> &variables
+  )
+{
+  return minimizeWith<MatrixXf, UnderdeterminedEquations>(f, variables);
+}
+
+
+float
+  minimizeLeastSquaresImpl(
+    const SparseLeastSquaresInterface &f,
+    vector<float> &variables
+  )
+{
+  using Jacobian = Eigen::SparseMatrix<float>;
+  return minimizeWith<Jacobian, SparseNormalEquations>(f, variables);
+}
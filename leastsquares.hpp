@@ -0,0 +1,117 @@
+#ifndef LEASTSQUARES_HPP_
+#define LEASTSQUARES_HPP_
+
+#include <Eigen/Dense>
+#include <Eigen/SparseCore>
+#include "vector.hpp"
+
+
+struct LeastSquaresInterface {
+  // Evaluates the residuals for the current values of the variables, along
+  // with the jacobian if jacobian_ptr is not null.
+  virtual void
+    operator()(
+      Eigen::VectorXf &residuals,
+      Eigen::MatrixXf *jacobian_ptr
+    ) const = 0;
+
+  // Called after each step that is taken.
+  virtual void iterationFinished(float /*error*/) const {}
+
+  // Checked after each step.  If it returns true, the minimization stops
+  // and the variables keep their values from the last step.
+  virtual bool shouldStop() const { return false; }
+};
+
+
+// This is for problems where each residual only depends on a few of the
+// variables.  The normal equations are then also kept sparse and solved
+// with a sparse Cholesky factorization.
+struct SparseLeastSquaresInterface {
+  virtual void
+    operator()(
+      Eigen::VectorXf &residuals,
+      Eigen::SparseMatrix<float> *jacobian_ptr
+    ) const = 0;
+
+  virtual void iterationFinished(float /*error*/) const {}
+  virtual bool shouldStop() const { return false; }
+};
+
+
+// Minimizes the sum of the squared residuals using Levenberg-Marquardt and
+// returns the minimum sum.
+extern float
+  minimizeLeastSquaresImpl(
+    const LeastSquaresInterface &,
+    vector<float> &/*variables*/
+  );
+
+extern float
+  minimizeLeastSquaresImpl(
+    const SparseLeastSquaresInterface &,
+    vector<float> &/*variables*/
+  );
+
+// For problems with fewer residuals than variables.  The damping is the
+// same for every variable, so that each step can be found by solving
+// equations the size of the residuals instead of the variables.
+extern float
+  minimizeUnderdeterminedLeastSquaresImpl(
+    const LeastSquaresInterface &,
+    vector<float> &/*variables*/
+  );
+
+
+template <typename Function>
+float minimizeLeastSquares(const Function &f, vector<float> &variables)
+{
+  struct WrappedFunction : LeastSquaresInterface {
+    const Function &f;
+
+    WrappedFunction(const Function &f_arg)
+    : f(f_arg)
+    {
+    }
+
+    void
+      operator()(
+        Eigen::VectorXf &residuals,
+        Eigen::MatrixXf *jacobian_ptr
+      ) const override
+    {
+      f(residuals, jacobian_ptr);
+    }
+  };
+
+  return minimizeLeastSquaresImpl(WrappedFunction(f), variables);
+}
+
+
+template <typename Function>
+float
+  minimizeSparseLeastSquares(const Function &f, vector<float> &variables)
+{
+  struct WrappedFunction : SparseLeastSquaresInterface {
+    const Function &f;
+
+    WrappedFunction(const Function &f_arg)
+    : f(f_arg)
+    {
+    }
+
+    void
+      operator()(
+        Eigen::VectorXf &residuals,
+        Eigen::SparseMatrix<float> *jacobian_ptr
+      ) const override
+    {
+      f(residuals, jacobian_ptr);
+    }
+  };
+
+  return minimizeLeastSquaresImpl(WrappedFunction(f), variables);
+}
+
+
+#endif /* LEASTSQUARES_HPP_ */
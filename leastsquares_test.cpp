@@ -0,0 +1,182 @@
+#include "leastsquares.hpp"
+
+#include <cassert>
+#include <iostream>
+#include <cmath>
+
+using std::cerr;
+using std::fabs;
+
+
+static void testLinear()
+{
+  vector<float> variables(1,0);
+
+  auto f = [&](Eigen::VectorXf &residuals, Eigen::MatrixXf *jacobian_ptr){
+    float x = variables[0];
+    residuals.resize(2);
+    residuals[0] = x - 1;
+    residuals[1] = x - 3;
+
+    if (jacobian_ptr) {
+      jacobian_ptr->resize(2,1);
+      (*jacobian_ptr)(0,0) = 1;
+      (*jacobian_ptr)(1,0) = 1;
+    }
+  };
+
+  float result = minimizeLeastSquares(f, variables);
+  float tolerance = 1e-5;
+  assert(fabs(variables[0] - 2) <= tolerance);
+  assert(fabs(result - 2) <= tolerance);
+}
+
+
+static void testRosenbrock()
+{
+  vector<float> variables = {-1.2, 1};
+
+  auto f = [&](Eigen::VectorXf &residuals, Eigen::MatrixXf *jacobian_ptr){
+    float x = variables[0];
+    float y = variables[1];
+    residuals.resize(2);
+    residuals[0] = 10*(y - x*x);
+    residuals[1] = 1 - x;
+
+    if (jacobian_ptr) {
+      Eigen::MatrixXf &jacobian = *jacobian_ptr;
+      jacobian.resize(2,2);
+      jacobian(0,0) = -20*x;
+      jacobian(0,1) = 10;
+      jacobian(1,0) = -1;
+      jacobian(1,1) = 0;
+    }
+  };
+
+  float result = minimizeLeastSquares(f, variables);
+  float x_delta = fabs(variables[0] - 1);
+  float y_delta = fabs(variables[1] - 1);
+  float tolerance = 1e-4;
+
+  if (x_delta > tolerance || y_delta > tolerance) {
+    cerr << "x_delta: " << x_delta << "\n";
+    cerr << "y_delta: " << y_delta << "\n";
+  }
+
+  assert(x_delta <= tolerance);
+  assert(y_delta <= tolerance);
+  assert(result <= 1e-8);
+}
+
+
+static void testUnusedVariable()
+{
+  vector<float> variables = {0, 5};
+
+  auto f = [&](Eigen::VectorXf &residuals, Eigen::MatrixXf *jacobian_ptr){
+    residuals.resize(1);
+    residuals[0] = variables[0] - 1;
+
+    if (jacobian_ptr) {
+      jacobian_ptr->resize(1,2);
+      (*jacobian_ptr)(0,0) = 1;
+      (*jacobian_ptr)(0,1) = 0;
+    }
+  };
+
+  minimizeLeastSquares(f, variables);
+  assert(fabs(variables[0] - 1) <= 1e-5);
+  assert(variables[1] == 5);
+}
+
+
+static void testSparse()
+{
+  // Each pair of variables is pulled towards its own value, with the
+  // first variable of each pair also tied to the second.
+  int n_pairs = 10;
+  vector<float> variables(n_pairs*2, 0);
+
+  auto f = [&](
+    Eigen::VectorXf &residuals,
+    Eigen::SparseMatrix<float> *jacobian_ptr
+  ){
+    residuals.resize(n_pairs*2);
+    vector<Eigen::Triplet<float>> entries;
+
+    for (int i = 0; i != n_pairs; ++i) {
+      float x = variables[i*2];
+      float y = variables[i*2 + 1];
+      residuals[i*2] = y - i;
+      residuals[i*2 + 1] = x - y;
+      entries.emplace_back(i*2, i*2 + 1, 1);
+      entries.emplace_back(i*2 + 1, i*2, 1);
+      entries.emplace_back(i*2 + 1, i*2 + 1, -1);
+    }
+
+    if (jacobian_ptr) {
+      jacobian_ptr->resize(n_pairs*2, n_pairs*2);
+      jacobian_ptr->setFromTriplets(entries.begin(), entries.end());
+    }
+  };
+
+  float result = minimizeSparseLeastSquares(f, variables);
+  float tolerance = 1e-4;
+  assert(result <= tolerance);
+
+  for (int i = 0; i != n_pairs; ++i) {
+    assert(fabs(variables[i*2] - i) <= tolerance);
+    assert(fabs(variables[i*2 + 1] - i) <= tolerance);
+  }
+}
+
+
+namespace {
+struct UnderdeterminedFunction : LeastSquaresInterface {
+  const vector<float> &variables;
+
+  UnderdeterminedFunction(const vector<float> &variables)
+  : variables(variables)
+  {
+  }
+
+  void
+    operator()(
+      Eigen::VectorXf &residuals,
+      Eigen::MatrixXf *jacobian_ptr
+    ) const override
+  {
+    residuals.resize(2);
+    residuals[0] = variables[0] + variables[1] + variables[2] - 3;
+    residuals[1] = variables[2] + variables[3]*variables[4] - 1;
+
+    if (jacobian_ptr) {
+      jacobian_ptr->setZero(2, 5);
+      jacobian_ptr->row(0).head(3).setOnes();
+      (*jacobian_ptr)(1,2) = 1;
+      (*jacobian_ptr)(1,3) = variables[4];
+      (*jacobian_ptr)(1,4) = variables[3];
+    }
+  }
+};
+}
+
+
+static void testUnderdetermined()
+{
+  // Two residuals with five variables, so there are many solutions.
+  vector<float> variables = {0, 0, 0, 1, 1};
+  UnderdeterminedFunction f(variables);
+  float result = minimizeUnderdeterminedLeastSquaresImpl(f, variables);
+  assert(result <= 1e-8);
+}
+
+
+int main()
+{
+  testLinear();
+  testRosenbrock();
+  testUnusedVariable();
+  testSparse();
+  testUnderdetermined();
+}
@@ -15,6 +15,8 @@
 #include "readobj.hpp"
 #include "objmesh.hpp"
 #include "vec3state.hpp"
+#include "asyncsolver.hpp"
+#include "coalescedcall.hpp"
 
 using View = MainWindowView;
 using std::cerr;
@@ -34,12 +36,62 @@ static bool anyFlagsAreSet(const F &for_each_function)
 
 
 struct MainWindowController::Impl {
+  struct NumericValueChange {
+    TreePath path;
+    NumericValue value;
+  };
+
   struct Data {
     View &view;
     ObservedScene observed_scene;
     Clipboard clipboard;
 
+    // This comes after the observed scene, so that its thread is stopped
+    // before the observed scene is destroyed.
+    AsyncSolver async_solver;
+
+    // Drag motions and numeric edits can come faster than the scene can be
+    // solved, so they are handled at most once per pass of the event loop,
+    // using the latest manipulator position or value.
+    CoalescedCall scene_changing_call;
+    Optional<NumericValueChange> maybe_numeric_value_change;
+    CoalescedCall numeric_value_change_call;
+
+    // The scene as it was solved when the previous change finished, which
+    // is saved at the start of each drag.  The preview is made from it,
+    // with the solve flags of the changing solve, the first time the drag
+    // needs it, and is only made again if those flags change.
+    Optional<SceneState> maybe_drag_start_state;
+    Optional<SolvePreview> maybe_solve_preview;
+
     Data(View &, Scene &, TreeWidget &);
+
+    // Handles the changes that are waiting for their call, so that other
+    // events see the scene with those changes.
+    void flushPendingChanges()
+    {
+      scene_changing_call.flush();
+      numeric_value_change_call.flush();
+    }
+
+    void dragFinished()
+    {
+      maybe_drag_start_state.reset();
+      maybe_solve_preview.reset();
+    }
+
+    void previewChangingSolve(SceneState &state);
+
+    void handleNumericValueChange()
+    {
+      if (!maybe_numeric_value_change) {
+        return;
+      }
+
+      NumericValueChange change = *maybe_numeric_value_change;
+      maybe_numeric_value_change.reset();
+      observed_scene.handleTreeNumericValueChanged(change.path, change.value);
+    }
   };
 
   Data data_member;
@@ -73,6 +125,13 @@ struct MainWindowController::Impl {
   static void handleSceneChanging(MainWindowController &);
   static void handleSceneChanged(MainWindowController &);
 
+  static void
+    handleTreeNumericValueChanged(
+      MainWindowController &,
+      const TreePath &,
+      NumericValue
+    );
+
   static Optional<NumericValue>
   evaluateInput(
     MainWindowController &controller, const string &text, const TreePath &path
@@ -170,9 +229,16 @@ MainWindowController::Impl::handleSceneChanging(
 )
 {
   // The mouse button is down.  The scene is being changed, but we don't
-  // consider this change complete.
+  // consider this change complete.  The scene is read when the call is
+  // made, so it uses the latest position of the manipulator.
+
+  Impl::Data &data = Impl::data(controller);
+
+  if (!data.maybe_drag_start_state) {
+    data.maybe_drag_start_state = data.observed_scene.scene_state;
+  }
 
-  Impl::observedScene(controller).handleSceneChanging();
+  data.scene_changing_call.request();
 }
 
 
@@ -181,10 +247,34 @@ void
     MainWindowController &controller
   )
 {
+  data(controller).flushPendingChanges();
+  data(controller).dragFinished();
   observedScene(controller).handleSceneChanged();
 }
 
 
+void
+  MainWindowController::Impl::handleTreeNumericValueChanged(
+    MainWindowController &controller,
+    const TreePath &path,
+    NumericValue value
+  )
+{
+  Data &data = Impl::data(controller);
+
+  if (
+    data.maybe_numeric_value_change &&
+    data.maybe_numeric_value_change->path != path
+  ) {
+    // Only later values for the same item replace the pending one.
+    data.numeric_value_change_call.flush();
+  }
+
+  data.maybe_numeric_value_change = NumericValueChange{path, value};
+  data.numeric_value_change_call.request();
+}
+
+
 void
   MainWindowController::Impl::addDistanceErrorPressed(
     MainWindowController &controller,
@@ -293,7 +383,6 @@ MainWindowController::Impl::pasteGlobalPressed(
 )
 {
   ObservedScene &observed_scene = observedScene(controller);
-  SceneState &scene_state = observed_scene.scene_state;
 
   Optional<BodyIndex> maybe_new_parent_body_index =
     maybeBodyIndexFromTreePath(path, observed_scene.tree_paths);
@@ -303,7 +392,7 @@ MainWindowController::Impl::pasteGlobalPressed(
       observed_scene.pasteBodyGlobal(maybe_new_parent_body_index);
 
     observed_scene.selectBody(new_body_index);
-    solveScene(scene_state);
+    observed_scene.solveScene();
     observed_scene.handleSceneStateChanged();
     return;
   }
@@ -313,7 +402,7 @@ MainWindowController::Impl::pasteGlobalPressed(
       observed_scene.pasteMarkerGlobal(maybe_new_parent_body_index);
 
     observed_scene.selectMarker(new_marker_index);
-    solveScene(scene_state);
+    observed_scene.solveScene();
     observed_scene.handleSceneStateChanged();
     return;
   }
@@ -814,6 +903,21 @@ MainWindowController::Impl::contextMenuItemsForPath(
 }
 
 
+// While the user is dragging, solving stops after about a frame, and the
+// next motion continues from there.
+static SolveOptions changingSolveOptions()
+{
+  SolveOptions options;
+  options.maybe_time_budget_seconds = 0.008;
+  return options;
+}
+
+
+// While the user is dragging, only the bodies that are close to what is
+// being dragged are solved.
+static const int changing_solve_hops = 2;
+
+
 MainWindowController::Impl::Data::Data(
   View &view_arg,
   Scene &scene_arg,
@@ -827,10 +931,74 @@ MainWindowController::Impl::Data::Data(
       updateErrorsInState(state);
     },
     [](SceneState &state){
-      solveScene(state);
+      return solveScene(state);
+    }
+  ),
+  async_solver(
+    [](SceneState &state, const std::atomic<bool> &cancel_flag){
+      SolveOptions options = changingSolveOptions();
+      options.cancel_flag_ptr = &cancel_flag;
+      return solveScene(state, options);
+    },
+    [this]{
+      view.callOnGuiThread([this]{
+        observed_scene.handleAsyncSolveFinished();
+      });
     }
+  ),
+  scene_changing_call(
+    [this](CoalescedCall::Function f){ view.callOnGuiThread(std::move(f)); },
+    [this]{ observed_scene.handleSceneChanging(); }
+  ),
+  numeric_value_change_call(
+    [this](CoalescedCall::Function f){ view.callOnGuiThread(std::move(f)); },
+    [this]{ handleNumericValueChange(); }
   )
 {
+  observed_scene.changing_preview_function = [this](SceneState &state){
+    previewChangingSolve(state);
+  };
+
+  observed_scene.async_solver_ptr = &async_solver;
+  observed_scene.maybe_changing_solve_hops = changing_solve_hops;
+}
+
+
+// Copies the solve flags of the bodies and meshes, which are the same
+// bodies and meshes in both scenes.
+static void
+  copySolveFlags(const SceneState &from_state, SceneState &to_state)
+{
+  for (auto body_index : indicesOf(from_state.bodies())) {
+    const SceneState::Body &from_body_state = from_state.body(body_index);
+    SceneState::Body &to_body_state = to_state.body(body_index);
+    to_body_state.solve_flags = from_body_state.solve_flags;
+
+    for (auto mesh_index : indicesOf(from_body_state.meshes)) {
+      to_body_state.meshes[mesh_index].scale_solve_flags =
+        from_body_state.meshes[mesh_index].scale_solve_flags;
+    }
+  }
+}
+
+
+void MainWindowController::Impl::Data::previewChangingSolve(SceneState &state)
+{
+  if (maybe_solve_preview && maybe_solve_preview->isValidFor(state)) {
+    maybe_solve_preview->apply(state);
+    return;
+  }
+
+  maybe_solve_preview.reset();
+
+  if (!maybe_drag_start_state || !SolvePreview::canPreview(state)) {
+    return;
+  }
+
+  SceneState solved_state = *maybe_drag_start_state;
+  copySolveFlags(state, solved_state);
+  maybe_solve_preview = SolvePreview(solved_state);
+  maybe_solve_preview->apply(state);
 }
 
 
@@ -839,46 +1007,56 @@ MainWindowController::MainWindowController(View &view)
 {
   TreeWidget &tree_widget = view.treeWidget();
   Scene &scene = view.scene();
-  ObservedScene &observed_scene = Impl::observedScene(*this);
   scene.changed_callback = [&]{ Impl::handleSceneChanged(*this); };
   scene.changing_callback = [&]{ Impl::handleSceneChanging(*this); };
 
+  Impl::Data &data = Impl::data(*this);
+
   scene.selection_changed_callback =
-    [&observed_scene]{ observed_scene.handleSceneSelectionChanged(); };
+    [&data]{
+      data.flushPendingChanges();
+      data.observed_scene.handleSceneSelectionChanged();
+    };
 
   tree_widget.evaluate_function =
     [this](const TreePath &path, const string &text){
+      Impl::data(*this).flushPendingChanges();
       return Impl::evaluateInput(*this, text, path);
     };
 
   tree_widget.enumeration_item_index_changed_callback =
-    [&observed_scene](const TreePath &path, int index){
-      observed_scene.handleTreeEnumerationIndexChanged(path, index);
+    [&data](const TreePath &path, int index){
+      data.flushPendingChanges();
+      data.observed_scene.handleTreeEnumerationIndexChanged(path, index);
     };
 
   tree_widget.selection_changed_callback =
-    [&observed_scene](){
-      observed_scene.handleTreeSelectionChanged();
+    [&data](){
+      data.flushPendingChanges();
+      data.observed_scene.handleTreeSelectionChanged();
     };
 
   tree_widget.context_menu_items_callback =
     [this](const TreePath &path){
+      Impl::data(*this).flushPendingChanges();
       return Impl::contextMenuItemsForPath(*this, path);
     };
 
   tree_widget.numeric_item_value_changed_callback =
-    [&observed_scene](const TreePath &path, NumericValue value){
-      observed_scene.handleTreeNumericValueChanged(path, value);
+    [this](const TreePath &path, NumericValue value){
+      Impl::handleTreeNumericValueChanged(*this, path, value);
     };
 
   tree_widget.string_item_value_changed_callback =
-    [&observed_scene](const TreePath &path, const StringValue &value){
-      observed_scene.handleTreeStringValueChanged(path, value);
+    [&data](const TreePath &path, const StringValue &value){
+      data.flushPendingChanges();
+      data.observed_scene.handleTreeStringValueChanged(path, value);
     };
 
   tree_widget.bool_item_value_changed_callback =
-    [&observed_scene](const TreePath &path, bool new_value){
-      observed_scene.handleTreeBoolValueChanged(path, new_value);
+    [&data](const TreePath &path, bool new_value){
+      data.flushPendingChanges();
+      data.observed_scene.handleTreeBoolValueChanged(path, new_value);
     };
 }
 
@@ -888,6 +1066,9 @@ MainWindowController::~MainWindowController() = default;
 
 void MainWindowController::replaceSceneStateWith(const SceneState &new_state)
 {
+  // Changes that are still waiting are for the old scene.
+  Impl::data(*this).flushPendingChanges();
+  Impl::data(*this).dragFinished();
   ObservedScene &observed_scene = Impl::observedScene(*this);
   SceneState solved_new_state = new_state;
   solveScene(solved_new_state);
@@ -909,6 +1090,7 @@ void MainWindowController::savePressed()
     // Cancelled
   }
   else {
+    Impl::data(*this).flushPendingChanges();
     saveScene(Impl::observedScene(*this).scene_state, *maybe_path);
   }
 }
@@ -2,6 +2,7 @@
 #define MAINWINDOWVIEW_HPP_
 
 #include <string>
+#include <functional>
 #include "optional.hpp"
 #include "treewidget.hpp"
 #include "scene.hpp"
@@ -12,6 +13,10 @@ struct MainWindowView {
   virtual Optional<std::string> askForOpenPath() = 0;
   virtual TreeWidget &treeWidget() = 0;
   virtual Scene &scene() = 0;
+
+  // This may be called from any thread.  The function gets called later
+  // on the thread that handles the user interface.
+  virtual void callOnGuiThread(std::function<void()>) = 0;
 };
 
 
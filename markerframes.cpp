@@ -0,0 +1,300 @@
+#include "markerframes.hpp"
+
+#include <sstream>
+#include "sceneerror.hpp"
+#include "threadpool.hpp"
+#include "globaltransform.hpp"
+#include "positionstate.hpp"
+
+using std::string;
+using std::istream;
+using std::ostream;
+
+
+static string componentName(XYZComponent component)
+{
+  switch (component) {
+    case XYZComponent::x: return "x";
+    case XYZComponent::y: return "y";
+    case XYZComponent::z: return "z";
+  }
+
+  assert(false);
+  return "";
+}
+
+
+static Optional<XYZComponent> maybeComponentWithName(const string &name)
+{
+  if (name == "x") return XYZComponent::x;
+  if (name == "y") return XYZComponent::y;
+  if (name == "z") return XYZComponent::z;
+  return {};
+}
+
+
+static bool isBlankOrComment(const string &line)
+{
+  string::size_type index = line.find_first_not_of(" \t\r");
+  return index == string::npos || line[index] == '#';
+}
+
+
+static Expected<MarkerFrames::Column>
+  columnWithName(const string &name, const SceneState &scene_state)
+{
+  string::size_type dot_index = name.rfind('.');
+
+  if (dot_index == string::npos) {
+    return Error{"Column " + name + " has no component"};
+  }
+
+  Optional<XYZComponent> maybe_component =
+    maybeComponentWithName(name.substr(dot_index + 1));
+
+  if (!maybe_component) {
+    return Error{"Column " + name + " has an unknown component"};
+  }
+
+  Optional<MarkerIndex> maybe_marker_index =
+    findMarkerWithName(scene_state, name.substr(0, dot_index));
+
+  if (!maybe_marker_index) {
+    return Error{"Column " + name + " has an unknown marker"};
+  }
+
+  return MarkerFrames::Column{*maybe_marker_index, *maybe_component};
+}
+
+
+Expected<MarkerFrames>
+  scanMarkerFramesFrom(istream &stream, const SceneState &scene_state)
+{
+  MarkerFrames result;
+  bool found_header = false;
+  string line;
+
+  while (std::getline(stream, line)) {
+    if (isBlankOrComment(line)) {
+      continue;
+    }
+
+    std::istringstream line_stream(line);
+
+    if (!found_header) {
+      string name;
+
+      while (std::getline(line_stream, name, '\t')) {
+        if (name.empty()) {
+          continue;
+        }
+
+        Expected<MarkerFrames::Column> expected_column =
+          columnWithName(name, scene_state);
+
+        if (expected_column.isError()) {
+          return expected_column.asError();
+        }
+
+        result.columns.push_back(expected_column.asValue());
+      }
+
+      found_header = true;
+      continue;
+    }
+
+    vector<float> values;
+    float value = 0;
+
+    while (line_stream >> value) {
+      values.push_back(value);
+    }
+
+    if (!line_stream.eof() || values.size() != result.columns.size()) {
+      std::ostringstream message;
+      message << "Frame " << result.frame_values.size() + 1;
+      message << " doesn't have a value for each column";
+      return Error{message.str()};
+    }
+
+    result.frame_values.push_back(values);
+  }
+
+  if (!found_header) {
+    return Error{"No columns"};
+  }
+
+  return result;
+}
+
+
+// Calls f with the name and value of each solved value of the scene.
+template <typename F>
+static void forEachSolvedValue(const SceneState &scene_state, const F &f)
+{
+  for (auto body_index : indicesOf(scene_state.bodies())) {
+    const SceneState::Body &body_state = scene_state.body(body_index);
+    const SceneState::TransformSolveFlags &solve_flags = body_state.solve_flags;
+    const TransformState &transform_state = body_state.transform;
+    const string &body_name = body_state.name;
+
+    forEachXYZComponent([&](XYZComponent c){
+      if (component(solve_flags.translation, c)) {
+        f(
+          body_name + ".translation." + componentName(c),
+          component(transform_state.translation, c)
+        );
+      }
+    });
+
+    forEachXYZComponent([&](XYZComponent c){
+      if (component(solve_flags.rotation, c)) {
+        f(
+          body_name + ".rotation." + componentName(c),
+          component(transform_state.rotation, c)
+        );
+      }
+    });
+
+    if (solve_flags.scale) {
+      f(body_name + ".scale", transform_state.scale);
+    }
+
+    for (auto mesh_index : indicesOf(body_state.meshes)) {
+      const SceneState::Mesh &mesh_state = body_state.meshes[mesh_index];
+      string mesh_name = body_name + ".mesh" + std::to_string(mesh_index);
+
+      forEachXYZComponent([&](XYZComponent c){
+        if (component(mesh_state.scale_solve_flags, c)) {
+          f(
+            mesh_name + ".scale." + componentName(c),
+            component(mesh_state.scale, c)
+          );
+        }
+      });
+    }
+  }
+}
+
+
+static void
+  setFrameMarkerPositions(
+    SceneState &scene_state,
+    const MarkerFrames &marker_frames,
+    size_t frame_index
+  )
+{
+  const vector<float> &values = marker_frames.frame_values[frame_index];
+
+  for (auto column_index : indicesOf(marker_frames.columns)) {
+    const MarkerFrames::Column &column = marker_frames.columns[column_index];
+    SceneState::Marker &marker_state = scene_state.marker(column.marker_index);
+
+    Transform body_global_transform =
+      scaledGlobalTransform(marker_state.maybe_body_index, scene_state);
+
+    PositionState global_position =
+      makePositionStateFromPoint(
+        body_global_transform*makePointFromPositionState(marker_state.position)
+      );
+
+    component(global_position, column.component) = values[column_index];
+
+    marker_state.position =
+      makePositionStateFromPoint(
+        body_global_transform.inverse()*
+        makePointFromPositionState(global_position)
+      );
+  }
+}
+
+
+static void
+  solveFrames(
+    const SceneState &base_scene_state,
+    const MarkerFrames &marker_frames,
+    size_t begin_frame_index,
+    size_t end_frame_index,
+    const SolveOptions &solve_options,
+    SolvedFrames &result
+  )
+{
+  SceneState scene_state = base_scene_state;
+
+  for (
+    size_t frame_index = begin_frame_index;
+    frame_index != end_frame_index;
+    ++frame_index
+  ) {
+    setFrameMarkerPositions(scene_state, marker_frames, frame_index);
+    solveScene(scene_state, solve_options);
+    vector<float> &values = result.frame_values[frame_index];
+    values.clear();
+
+    forEachSolvedValue(scene_state, [&](const string &, float value){
+      values.push_back(value);
+    });
+
+    result.frame_errors[frame_index] = sceneError(scene_state);
+  }
+}
+
+
+SolvedFrames
+  solveMarkerFrames(
+    const SceneState &base_scene_state,
+    const MarkerFrames &marker_frames,
+    const MarkerFramesSolveOptions &options
+  )
+{
+  SolvedFrames result;
+  size_t n_frames = marker_frames.frame_values.size();
+  result.frame_values.resize(n_frames);
+  result.frame_errors.resize(n_frames);
+
+  forEachSolvedValue(base_scene_state, [&](const string &name, float){
+    result.channel_names.push_back(name);
+  });
+
+  size_t n_chunks = std::max<size_t>(1, std::min(options.n_chunks, n_frames));
+
+  auto solve_chunk = [&](size_t chunk_index, size_t){
+    solveFrames(
+      base_scene_state,
+      marker_frames,
+      chunk_index*n_frames/n_chunks,
+      (chunk_index + 1)*n_frames/n_chunks,
+      options.solve_options,
+      result
+    );
+  };
+
+  if (options.thread_pool_ptr) {
+    options.thread_pool_ptr->forEachIndex(n_chunks, solve_chunk);
+  }
+  else {
+    for (size_t i = 0; i != n_chunks; ++i) {
+      solve_chunk(i, /*thread_index*/0);
+    }
+  }
+
+  return result;
+}
+
+
+void printSolvedFramesOn(ostream &stream, const SolvedFrames &solved_frames)
+{
+  for (const string &name : solved_frames.channel_names) {
+    stream << name << "\t";
+  }
+
+  stream << "error\n";
+
+  for (auto frame_index : indicesOf(solved_frames.frame_values)) {
+    for (float value : solved_frames.frame_values[frame_index]) {
+      stream << value << "\t";
+    }
+
+    stream << solved_frames.frame_errors[frame_index] << "\n";
+  }
+}
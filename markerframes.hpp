@@ -0,0 +1,70 @@
+#ifndef MARKERFRAMES_HPP_
+#define MARKERFRAMES_HPP_
+
+#include <iosfwd>
+#include "scenestate.hpp"
+#include "scenesolver.hpp"
+#include "expected.hpp"
+
+
+// Marker positions for a sequence of frames, such as captured marker
+// data.  Each column sets one coordinate of one marker.  The positions are
+// global, so markers that are on a body are moved to the given global
+// positions using the body's transform at the start of the frame.
+struct MarkerFrames {
+  struct Column {
+    MarkerIndex marker_index;
+    XYZComponent component;
+  };
+
+  vector<Column> columns;
+
+  // A row of values for each frame, with a value for each column.
+  vector<vector<float>> frame_values;
+};
+
+
+// The values that were solved for each frame.
+struct SolvedFrames {
+  // A name for each solved value, such as "body1.rotation.x".
+  vector<std::string> channel_names;
+
+  // A row for each frame, with a value for each channel.
+  vector<vector<float>> frame_values;
+
+  vector<float> frame_errors;
+};
+
+
+struct MarkerFramesSolveOptions {
+  SolveOptions solve_options;
+
+  // Each frame is solved starting from the solution of the frame before
+  // it.  If there is more than one chunk, the frames are split into that
+  // many runs of consecutive frames, which start from the base scene and
+  // are solved concurrently if there is a thread pool.
+  size_t n_chunks = 1;
+  ThreadPool *thread_pool_ptr = nullptr;
+};
+
+
+// The columns are separated by tabs, since names can have spaces.  The
+// first line that isn't empty or a comment starting with '#' names the
+// columns, as in "marker1.x", "marker1.y" and "marker1.z".  Each line
+// after that has the values for one frame.
+extern Expected<MarkerFrames>
+  scanMarkerFramesFrom(std::istream &, const SceneState &);
+
+extern SolvedFrames
+  solveMarkerFrames(
+    const SceneState &base_scene_state,
+    const MarkerFrames &,
+    const MarkerFramesSolveOptions & = MarkerFramesSolveOptions()
+  );
+
+// Prints a line with the channel names, followed by a line of values for
+// each frame, ending with the total error of the frame, with the columns
+// separated by tabs.
+extern void printSolvedFramesOn(std::ostream &, const SolvedFrames &);
+
+#endif /* MARKERFRAMES_HPP_ */
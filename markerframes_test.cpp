@@ -0,0 +1,161 @@
+#include "markerframes.hpp"
+
+#include <sstream>
+#include <iostream>
+#include "threadpool.hpp"
+#include "assertnearfloat.hpp"
+#include "globaltransform.hpp"
+#include "positionstate.hpp"
+
+using std::istringstream;
+using std::ostringstream;
+using std::cerr;
+using std::string;
+
+
+// A body with local markers at the origin and on the x and y axes, which
+// are pulled towards the global markers "g0", "g1" and "g2".
+static SceneState makeScene()
+{
+  SceneState scene_state;
+  BodyIndex body_index = scene_state.createBody();
+  SceneState::Body &body_state = scene_state.body(body_index);
+  body_state.name = "body";
+  body_state.solve_flags.translation = {true, true, true};
+  SceneState::XYZ local_positions[] = {{0,0,0}, {1,0,0}, {0,1,0}};
+
+  for (int i = 0; i != 3; ++i) {
+    MarkerIndex local_index = scene_state.createMarker(body_index);
+    scene_state.marker(local_index).position = local_positions[i];
+    string global_name = "g" + std::to_string(i);
+    MarkerIndex global_index = scene_state.createMarker(global_name);
+    scene_state.marker(global_index).position = local_positions[i];
+    DistanceErrorIndex error_index = scene_state.createDistanceError();
+
+    SceneState::DistanceError &distance_error_state =
+      scene_state.distance_errors[error_index];
+
+    distance_error_state.setStart(Marker(local_index));
+    distance_error_state.setEnd(Marker(global_index));
+  }
+
+  return scene_state;
+}
+
+
+// Each frame moves the global markers one unit further in x.
+static MarkerFrames makeFrames(const SceneState &scene_state, int n_frames)
+{
+  ostringstream stream;
+  stream << "# Captured markers\n";
+  stream << "g0.x\tg1.x\tg2.x\tg2.y\n";
+
+  for (int i = 1; i <= n_frames; ++i) {
+    stream << i << " " << i + 1 << " " << i << " 1\n";
+  }
+
+  istringstream input(stream.str());
+  Expected<MarkerFrames> expected = scanMarkerFramesFrom(input, scene_state);
+  assert(expected.isValue());
+  return expected.asValue();
+}
+
+
+static void testScanning()
+{
+  SceneState scene_state = makeScene();
+  MarkerFrames frames = makeFrames(scene_state, /*n_frames*/3);
+  assert(frames.columns.size() == 4);
+  assert(frames.columns[3].component == XYZComponent::y);
+  assert(frames.frame_values.size() == 3);
+  assert(frames.frame_values[2][1] == 4);
+
+  {
+    istringstream stream("g0.x\tg3.x\n1\t2\n");
+    assert(scanMarkerFramesFrom(stream, scene_state).isError());
+  }
+
+  {
+    istringstream stream("g0.x\tg1.x\n1\n");
+    assert(scanMarkerFramesFrom(stream, scene_state).isError());
+  }
+}
+
+
+static void testSolving()
+{
+  SceneState scene_state = makeScene();
+  int n_frames = 6;
+  MarkerFrames frames = makeFrames(scene_state, n_frames);
+  ThreadPool thread_pool(/*n_threads*/2);
+
+  for (size_t n_chunks : {1, 3}) {
+    MarkerFramesSolveOptions options;
+    options.n_chunks = n_chunks;
+    options.thread_pool_ptr = &thread_pool;
+    SolvedFrames solved = solveMarkerFrames(scene_state, frames, options);
+    assert(solved.channel_names.size() == 3);
+    assert(solved.channel_names[0] == "body.translation.x");
+    assert(int(solved.frame_values.size()) == n_frames);
+
+    for (int i = 0; i != n_frames; ++i) {
+      assertNear(solved.frame_values[i][0], i + 1, 1e-3);
+      assertNear(solved.frame_values[i][1], 0, 1e-3);
+      assertNear(solved.frame_errors[i], 0, 1e-5);
+    }
+
+    ostringstream stream;
+    printSolvedFramesOn(stream, solved);
+
+    assert(
+      stream.str().substr(0, 60) ==
+      "body.translation.x\tbody.translation.y\tbody.translation.z\terr"
+    );
+  }
+}
+
+
+// The frames give global positions, even for markers that are on a body.
+static void testSolvingWithMarkersOnABody()
+{
+  SceneState scene_state = makeScene();
+  BodyIndex capture_index = scene_state.createBody();
+  TransformState &capture_transform = scene_state.body(capture_index).transform;
+  capture_transform.translation = {0, 0, 5};
+  capture_transform.rotation = {0, 0, 90};
+  Transform capture_global = scaledGlobalTransform(capture_index, scene_state);
+
+  // Move the global markers onto the body without changing where they are.
+  for (auto marker_index : indicesOf(scene_state.markers())) {
+    SceneState::Marker &marker_state = scene_state.marker(marker_index);
+
+    if (!marker_state.maybe_body_index) {
+      Point global = makePointFromPositionState(marker_state.position);
+
+      marker_state.position =
+        makePositionStateFromPoint(capture_global.inverse()*global);
+
+      marker_state.maybe_body_index = capture_index;
+    }
+  }
+
+  int n_frames = 3;
+  MarkerFrames frames = makeFrames(scene_state, n_frames);
+  SolvedFrames solved = solveMarkerFrames(scene_state, frames);
+  assert(solved.channel_names.size() == 3);
+
+  for (int i = 0; i != n_frames; ++i) {
+    assertNear(solved.frame_values[i][0], i + 1, 1e-3);
+    assertNear(solved.frame_values[i][1], 0, 1e-3);
+    assertNear(solved.frame_values[i][2], 0, 1e-3);
+    assertNear(solved.frame_errors[i], 0, 1e-5);
+  }
+}
+
+
+int main()
+{
+  testScanning();
+  testSolving();
+  testSolvingWithMarkersOnABody();
+}
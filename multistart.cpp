@@ -0,0 +1,158 @@
+#include "multistart.hpp"
+
+#include <chrono>
+#include <limits>
+#include "sceneerror.hpp"
+#include "threadpool.hpp"
+#include "transformstate.hpp"
+#include "randomtransform.hpp"
+#include "indicesof.hpp"
+#include "globaltransform.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+
+static double secondsSince(Clock::time_point start_time)
+{
+  return std::chrono::duration<double>(Clock::now() - start_time).count();
+}
+
+
+static void
+  randomizeSolvedTransforms(
+    SceneState &scene_state,
+    float translation_spread,
+    RandomEngine &engine
+  )
+{
+  for (auto body_index : indicesOf(scene_state.bodies())) {
+    SceneState::Body &body_state = scene_state.body(body_index);
+    const SceneState::TransformSolveFlags &solve_flags = body_state.solve_flags;
+    TransformState &transform_state = body_state.transform;
+
+    // The translation of the random transform is a random point with
+    // coordinates between -1 and 1.
+    TransformState random_state =
+      transformState(randomTransform(engine), /*scale*/1);
+
+    forEachXYZComponent([&](XYZComponent c){
+      if (solve_flags.translation.component(c)) {
+        transform_state.translation.component(c) +=
+          random_state.translation.component(c)*translation_spread;
+      }
+
+      if (solve_flags.rotation.component(c)) {
+        transform_state.rotation.component(c) =
+          random_state.rotation.component(c);
+      }
+    });
+  }
+}
+
+
+float defaultTranslationSpread(const SceneState &scene_state)
+{
+  if (scene_state.markers().empty()) {
+    return 0;
+  }
+
+  GlobalTransformCache transform_cache(scene_state);
+  float infinity = std::numeric_limits<float>::infinity();
+  Point min_position = Point::Constant(infinity);
+  Point max_position = Point::Constant(-infinity);
+
+  for (auto marker_index : indicesOf(scene_state.markers())) {
+    Point position =
+      markerPredicted(scene_state, marker_index, transform_cache);
+
+    min_position = min_position.cwiseMin(position);
+    max_position = max_position.cwiseMax(position);
+  }
+
+  return (max_position - min_position).maxCoeff();
+}
+
+
+MultiStartSolveResult
+  solveSceneFromMultipleStarts(
+    SceneState &scene_state,
+    const MultiStartSolveOptions &options
+  )
+{
+  Clock::time_point start_time = Clock::now();
+  const SolveOptions &solve_options = options.solve_options;
+  size_t n_starts = std::max<size_t>(1, options.n_starts);
+  vector<SceneState> start_states(n_starts, scene_state);
+  vector<SolveStats> start_stats(n_starts);
+  MultiStartSolveResult result;
+  result.start_errors.resize(n_starts);
+
+  float translation_spread =
+    options.maybe_translation_spread ?
+    *options.maybe_translation_spread :
+    defaultTranslationSpread(scene_state);
+
+  auto solve_start = [&](size_t start_index, size_t){
+    SolveOptions start_options = solve_options;
+
+    if (options.thread_pool_ptr) {
+      start_options.thread_pool_ptr = nullptr;
+    }
+
+    if (solve_options.maybe_time_budget_seconds) {
+      double remaining_seconds =
+        *solve_options.maybe_time_budget_seconds - secondsSince(start_time);
+
+      if (remaining_seconds <= 0 && start_index != 0) {
+        return;
+      }
+
+      start_options.maybe_time_budget_seconds =
+        std::max(remaining_seconds, 0.0);
+    }
+
+    if (
+      solve_options.cancel_flag_ptr && *solve_options.cancel_flag_ptr &&
+      start_index != 0
+    ) {
+      return;
+    }
+
+    SceneState &start_state = start_states[start_index];
+
+    if (start_index != 0) {
+      RandomEngine engine(options.seed + start_index);
+
+      randomizeSolvedTransforms(
+        start_state, translation_spread, engine
+      );
+    }
+
+    start_stats[start_index] = solveScene(start_state, start_options);
+    result.start_errors[start_index] = sceneError(start_state);
+  };
+
+  if (options.thread_pool_ptr) {
+    options.thread_pool_ptr->forEachIndex(n_starts, solve_start);
+  }
+  else {
+    for (size_t i = 0; i != n_starts; ++i) {
+      solve_start(i, /*thread_index*/0);
+    }
+  }
+
+  for (size_t start_index = 1; start_index != n_starts; ++start_index) {
+    const Optional<float> &maybe_error = result.start_errors[start_index];
+
+    if (
+      maybe_error &&
+      *maybe_error < *result.start_errors[result.best_start_index]
+    ) {
+      result.best_start_index = start_index;
+    }
+  }
+
+  scene_state = std::move(start_states[result.best_start_index]);
+  result.stats = start_stats[result.best_start_index];
+  return result;
+}
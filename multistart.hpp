@@ -0,0 +1,60 @@
+#ifndef MULTISTART_HPP_
+#define MULTISTART_HPP_
+
+#include "scenestate.hpp"
+#include "scenesolver.hpp"
+
+
+struct MultiStartSolveOptions {
+  // The time budget is shared by all the starts: each start that begins
+  // gets whatever is left of it, and the starts that haven't begun when it
+  // runs out are skipped.  The first start always begins so that there is
+  // a result, but it may have no time left to improve the scene.
+  SolveOptions solve_options;
+
+  // The first start is the scene as it is.  The others start with the
+  // solved rotation components of each body set from a random rotation,
+  // and the solved translation components moved randomly by up to the
+  // translation spread in each direction, which is enough to get out of
+  // the local minima that the solvers can stop in.  If no spread is given,
+  // defaultTranslationSpread() of the scene is used.
+  size_t n_starts = 8;
+  Optional<float> maybe_translation_spread;
+
+  // Each start gets its own random engine seeded with this plus the start
+  // index, so the starts are the same no matter which thread solves them.
+  unsigned seed = 1;
+
+  // If given, the starts are solved concurrently, and the solve of each
+  // start doesn't use the pool itself.  The number of threads in the pool
+  // is how many starts are solved at once.
+  ThreadPool *thread_pool_ptr = nullptr;
+};
+
+
+struct MultiStartSolveResult {
+  // The stats of the start that was kept.
+  SolveStats stats;
+  size_t best_start_index = 0;
+
+  // The total error that each start was solved to, or nothing if the time
+  // budget ran out or the solve was cancelled before the start began.
+  vector<Optional<float>> start_errors;
+};
+
+
+// The largest extent of the box around the global positions of the
+// markers, so that the starts can cover the whole scene.
+extern float defaultTranslationSpread(const SceneState &);
+
+
+// Solves the scene from several starts and leaves it with the solution that
+// has the lowest total error, preferring earlier starts when the errors are
+// the same.
+extern MultiStartSolveResult
+  solveSceneFromMultipleStarts(
+    SceneState &,
+    const MultiStartSolveOptions & = MultiStartSolveOptions()
+  );
+
+#endif /* MULTISTART_HPP_ */
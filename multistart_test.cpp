@@ -0,0 +1,108 @@
+#include "multistart.hpp"
+
+#include "sceneerror.hpp"
+#include "threadpool.hpp"
+#include "assertnearfloat.hpp"
+
+
+// A body that can only rotate about z, with a local marker on the x axis
+// that is pulled towards a global marker on the other side of the origin.
+// The body starts unrotated, where the error is at its maximum and doesn't
+// change to first order, so solving from there doesn't get anywhere.
+static SceneState makeScene()
+{
+  SceneState scene_state;
+  BodyIndex body_index = scene_state.createBody();
+  scene_state.body(body_index).solve_flags.rotation.z = true;
+  MarkerIndex local_index = scene_state.createMarker(body_index);
+  scene_state.marker(local_index).position = {1, 0, 0};
+  MarkerIndex global_index = scene_state.createMarker();
+  scene_state.marker(global_index).position = {-1, 0, 0};
+  DistanceErrorIndex error_index = scene_state.createDistanceError();
+
+  SceneState::DistanceError &distance_error_state =
+    scene_state.distance_errors[error_index];
+
+  distance_error_state.setStart(Marker(local_index));
+  distance_error_state.setEnd(Marker(global_index));
+  return scene_state;
+}
+
+
+static void testSingleStart()
+{
+  SceneState scene_state = makeScene();
+  MultiStartSolveOptions options;
+  options.n_starts = 1;
+
+  MultiStartSolveResult result =
+    solveSceneFromMultipleStarts(scene_state, options);
+
+  assert(result.best_start_index == 0);
+  assert(result.start_errors.size() == 1);
+  assert(*result.start_errors[0] == sceneError(scene_state));
+  assert(sceneError(scene_state) > 1);
+}
+
+
+static void testEscapingALocalMaximum()
+{
+  ThreadPool thread_pool(/*n_threads*/2);
+
+  for (ThreadPool *thread_pool_ptr : {(ThreadPool *)nullptr, &thread_pool}) {
+    SceneState scene_state = makeScene();
+    MultiStartSolveOptions options;
+    options.thread_pool_ptr = thread_pool_ptr;
+
+    MultiStartSolveResult result =
+      solveSceneFromMultipleStarts(scene_state, options);
+
+    assert(result.best_start_index != 0);
+    assert(result.start_errors.size() == options.n_starts);
+    assertNear(sceneError(scene_state), 0, 1e-4);
+    assertNear(std::abs(scene_state.body(0).transform.rotation.z), 180, 0.1);
+
+    // The translation isn't solved, so it doesn't change.
+    assert(scene_state.body(0).transform.translation.x == 0);
+  }
+}
+
+
+static void testDefaultTranslationSpread()
+{
+  SceneState scene_state = makeScene();
+  assertNear(defaultTranslationSpread(scene_state), 2, 1e-6);
+
+  // The local marker is moved along with its body.
+  scene_state.body(0).transform.translation.y = 3;
+  assertNear(defaultTranslationSpread(scene_state), 3, 1e-6);
+  assert(defaultTranslationSpread(SceneState()) == 0);
+}
+
+
+static void testRunningOutOfTime()
+{
+  SceneState scene_state = makeScene();
+  MultiStartSolveOptions options;
+  options.solve_options.maybe_time_budget_seconds = 0;
+
+  MultiStartSolveResult result =
+    solveSceneFromMultipleStarts(scene_state, options);
+
+  // Only the first start begins.
+  assert(result.best_start_index == 0);
+  assert(result.start_errors[0]);
+
+  for (size_t i = 1; i != options.n_starts; ++i) {
+    assert(!result.start_errors[i]);
+  }
+}
+
+
+int main()
+{
+  testSingleStart();
+  testEscapingALocalMaximum();
+  testDefaultTranslationSpread();
+  testRunningOutOfTime();
+}
@@ -17,6 +17,9 @@
 #include "vec3state.hpp"
 #include "pointlink.hpp"
 #include "solveflags.hpp"
+#include "asyncsolver.hpp"
+#include "solvedvalues.hpp"
+#include "solvegraph.hpp"
 
 using std::string;
 using std::ostringstream;
@@ -878,7 +881,7 @@ ObservedScene::convertBoxToMesh(BodyIndex body_index, BoxIndex box_index)
   MeshIndex mesh_index = addMeshTo(body_index, mesh_shape);
   scene_state.body(body_index).meshes[mesh_index].scale = box_state.scale;
   updateSceneObjects(scene, scene_handles, scene_state);
-  updateTreeValues(tree_widget, tree_paths, scene_state);
+  updateTreeValues(tree_widget, tree_paths, scene_state, shownSolveStatsPtr());
   return mesh_index;
 }
 
@@ -1978,7 +1981,7 @@ ObservedScene::ObservedScene(
   Scene &scene,
   TreeWidget &tree_widget,
   std::function<void(SceneState &)> update_errors_function,
-  std::function<void(SceneState &)> solve_function
+  std::function<SolveStats(SceneState &)> solve_function
 )
 : scene(scene),
   tree_widget(tree_widget),
@@ -2162,10 +2165,15 @@ bool ObservedScene::canPasteTo(Optional<BodyIndex> maybe_body_index)
 
 void ObservedScene::replaceSceneStateWith(const SceneState &new_state)
 {
+  if (async_solver_ptr) {
+    async_solver_ptr->cancel();
+  }
+
   removeExistingManipulator(scene_handles, scene);
   destroySceneObjects(scene, scene_state, scene_handles);
   clearTree(tree_widget, tree_paths);
   clipboard.maybe_cut_body_index.reset();
+  maybe_solved_fingerprint.reset();
   scene_state = new_state;
   scene_handles = createSceneObjects(scene_state, scene);
   tree_paths = fillTree(tree_widget, scene_state);
@@ -2174,7 +2182,34 @@ void ObservedScene::replaceSceneStateWith(const SceneState &new_state)
 
 void ObservedScene::solveScene()
 {
-  solve_function(scene_state);
+  if (async_solver_ptr) {
+    // A solve that was started earlier would be out of date.
+    async_solver_ptr->cancel();
+  }
+
+  if (maybe_solved_fingerprint == solveFingerprint(scene_state)) {
+    return;
+  }
+
+  solve_stats = solve_function(scene_state);
+
+  if (solve_stats.ran_out_of_budget) {
+    // Solving again could get further.
+    maybe_solved_fingerprint.reset();
+  }
+  else {
+    maybe_solved_fingerprint = solveFingerprint(scene_state);
+  }
+}
+
+
+const SolveStats *ObservedScene::shownSolveStatsPtr() const
+{
+  if (!show_solve_stats) {
+    return nullptr;
+  }
+
+  return &solve_stats;
 }
 
 
@@ -2390,7 +2425,7 @@ ObservedScene::createDistanceError(
   );
 
   updateSceneObjects(scene, scene_handles, scene_state);
-  updateTreeValues(tree_widget, tree_paths, scene_state);
+  updateTreeValues(tree_widget, tree_paths, scene_state, shownSolveStatsPtr());
   return DistanceError(index);
 }
 
@@ -2472,7 +2507,7 @@ bool *ObservedScene::solveStatePtr(const TreePath &path)
 
 void ObservedScene::handleSceneStateChanged()
 {
-  updateTreeValues(tree_widget, tree_paths, scene_state);
+  updateTreeValues(tree_widget, tree_paths, scene_state, shownSolveStatsPtr());
   updateSceneObjects(scene, scene_handles, scene_state);
 }
 
@@ -2678,7 +2713,9 @@ ObservedScene::handleTreeStringValueChanged(
   }
 
   if (value_was_changed) {
-    updateTreeValues(tree_widget, tree_paths, scene_state);
+    updateTreeValues(
+      tree_widget, tree_paths, scene_state, shownSolveStatsPtr()
+    );
     updateTreeDistanceErrors(tree_widget, tree_paths, scene_state);
   }
   else {
@@ -2899,6 +2936,137 @@ forEachSolveFlagAffectingHandle(
 }
 
 
+namespace {
+struct BodySolveFlags {
+  SceneState::TransformSolveFlags transform;
+  vector<SceneState::XYZSolveFlags> mesh_scales;
+};
+}
+
+
+static vector<BodySolveFlags> bodySolveFlags(const SceneState &state)
+{
+  vector<BodySolveFlags> result;
+
+  for (auto body_index : indicesOf(state.bodies())) {
+    const SceneState::Body &body_state = state.body(body_index);
+    result.emplace_back();
+    result.back().transform = body_state.solve_flags;
+
+    for (const SceneState::Mesh &mesh_state : body_state.meshes) {
+      result.back().mesh_scales.push_back(mesh_state.scale_solve_flags);
+    }
+  }
+
+  return result;
+}
+
+
+static void
+  setBodySolveFlags(SceneState &state, const vector<BodySolveFlags> &flags)
+{
+  for (auto body_index : indicesOf(state.bodies())) {
+    SceneState::Body &body_state = state.body(body_index);
+    body_state.solve_flags = flags[body_index].transform;
+
+    for (auto mesh_index : indicesOf(body_state.meshes)) {
+      body_state.meshes[mesh_index].scale_solve_flags =
+        flags[body_index].mesh_scales[mesh_index];
+    }
+  }
+}
+
+
+static vector<DistanceErrorIndex>
+  markerDistanceErrors(MarkerIndex marker_index, const SceneState &state)
+{
+  vector<DistanceErrorIndex> result;
+
+  for (auto error_index : indicesOf(state.distance_errors)) {
+    const SceneState::DistanceError &distance_error_state =
+      state.distance_errors[error_index];
+
+    for (
+      const Optional<PointLink> *maybe_point_ptr : {
+        &distance_error_state.optional_start,
+        &distance_error_state.optional_end
+      }
+    ) {
+      const Optional<PointLink> &maybe_point = *maybe_point_ptr;
+
+      if (maybe_point && maybe_point->maybe_marker == Marker(marker_index)) {
+        result.push_back(error_index);
+        break;
+      }
+    }
+  }
+
+  return result;
+}
+
+
+// The distance errors that change when the element is manipulated.
+static vector<DistanceErrorIndex>
+  manipulatedElementErrors(
+    const OptionalManipulatedElement &element,
+    const SceneState &state
+  )
+{
+  if (element.maybe_body_index) {
+    return bodyDistanceErrors(state, *element.maybe_body_index);
+  }
+
+  if (element.maybe_marker_index) {
+    return markerDistanceErrors(*element.maybe_marker_index, state);
+  }
+
+  if (element.maybe_body_mesh) {
+    return bodyDistanceErrors(state, element.maybe_body_mesh->body.index);
+  }
+
+  if (element.maybe_body_mesh_position) {
+    return
+      bodyDistanceErrors(
+        state, element.maybe_body_mesh_position->array.body_mesh.body.index
+      );
+  }
+
+  return {};
+}
+
+
+// Turns off the solve flags of the bodies that aren't near the manipulated
+// element.
+static void
+  freezeBodiesAwayFromManipulatedElement(
+    SceneState &state,
+    const SceneHandles &scene_handles,
+    int max_hops
+  )
+{
+  vector<bool> is_near =
+    bodiesNearErrors(
+      state,
+      manipulatedElementErrors(scene_handles.maybe_manipulated_element, state),
+      max_hops
+    );
+
+  for (auto body_index : indicesOf(state.bodies())) {
+    if (is_near[body_index]) {
+      continue;
+    }
+
+    SceneState::Body &body_state = state.body(body_index);
+    setAll(body_state.solve_flags, false);
+    body_state.solve_flags.scale = false;
+
+    for (SceneState::Mesh &mesh_state : body_state.meshes) {
+      setAll(mesh_state.scale_solve_flags, false);
+    }
+  }
+}
+
+
 static void handleSceneChanging(ObservedScene &observed_scene)
 {
   bool update_scene_state = true;
@@ -2906,6 +3074,7 @@ static void handleSceneChanging(ObservedScene &observed_scene)
   SceneHandles &scene_handles = observed_scene.scene_handles;
   Scene &scene = observed_scene.scene;
   SceneState &state = observed_scene.scene_state;
+  forgetManipulatedElementValues(scene_handles);
 
   if (scene_handles.maybe_translate_manipulator) {
     TransformHandle translate_manipulator =
@@ -3054,7 +3223,36 @@ static void handleSceneChanging(ObservedScene &observed_scene)
     }
   );
 
-  observed_scene.solveScene();
+  vector<BodySolveFlags> unfrozen_flags;
+
+  if (observed_scene.maybe_changing_solve_hops) {
+    unfrozen_flags = bodySolveFlags(state);
+
+    freezeBodiesAwayFromManipulatedElement(
+      state, scene_handles, *observed_scene.maybe_changing_solve_hops
+    );
+  }
+
+  if (observed_scene.changing_preview_function) {
+    observed_scene.changing_preview_function(state);
+  }
+
+  if (observed_scene.async_solver_ptr) {
+    // The copy that gets solved has the solve flags that are disabled
+    // while manipulating.
+    observed_scene.async_solver_ptr->request(state);
+  }
+  else if (observed_scene.changing_solve_function) {
+    observed_scene.solve_stats = observed_scene.changing_solve_function(state);
+    observed_scene.maybe_solved_fingerprint.reset();
+  }
+  else {
+    observed_scene.solveScene();
+  }
+
+  if (observed_scene.maybe_changing_solve_hops) {
+    setBodySolveFlags(state, unfrozen_flags);
+  }
 
   // Restore the old solve states.
   {
@@ -3086,3 +3284,27 @@ void ObservedScene::handleSceneChanged()
   solveScene();
   handleSceneStateChanged();
 }
+
+
+void ObservedScene::handleAsyncSolveFinished()
+{
+  assert(async_solver_ptr);
+
+  Optional<AsyncSolver::Result> maybe_result =
+    async_solver_ptr->takeResult();
+
+  if (!maybe_result) {
+    // There was a newer request by the time we got here.
+    return;
+  }
+
+  if (!haveSameBodiesAndMeshes(maybe_result->scene_state, scene_state)) {
+    return;
+  }
+
+  copySolvedValues(maybe_result->scene_state, scene_state);
+  update_errors_function(scene_state);
+  solve_stats = maybe_result->stats;
+  maybe_solved_fingerprint.reset();
+  handleSceneStateChanged();
+}
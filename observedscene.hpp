@@ -6,6 +6,10 @@
 #include "markernamemap.hpp"
 #include "stringvalue.hpp"
 #include "sceneelementdescription.hpp"
+#include "solvestats.hpp"
+#include "solvefingerprint.hpp"
+
+class AsyncSolver;
 
 
 enum class ManipulationType {
@@ -36,13 +40,49 @@ struct ObservedScene {
   TreePaths tree_paths;
   Clipboard clipboard;
   std::function<void(SceneState&)> update_errors_function;
-  std::function<void(SceneState&)> solve_function;
+  std::function<SolveStats(SceneState&)> solve_function;
+
+  // The stats from the last call to solveScene(), which are shown with
+  // the total error in the tree if show_solve_stats is set.
+  SolveStats solve_stats;
+  bool show_solve_stats = false;
+
+  // If set, this is used instead of solve_function while the scene is
+  // changing, so that it can stop early and leave the rest of the solve
+  // for the next change.  The scene is fully solved when the change is
+  // finished.
+  std::function<SolveStats(SceneState&)> changing_solve_function;
+
+  // If set, this is applied while the scene is changing, before the solve,
+  // to quickly estimate the solved values, so the scene can follow a drag
+  // even when solving takes longer than a frame.  It is given the state
+  // with the solve flags that are used for the changing solve.
+  std::function<void(SceneState&)> changing_preview_function;
+
+  // If set, the solve while the scene is changing is done by requesting it
+  // from this instead of solving directly, and handleAsyncSolveFinished()
+  // applies the result once it is ready.
+  AsyncSolver *async_solver_ptr = nullptr;
+
+  // If set, only the bodies within this many hops of the manipulated
+  // element, as counted by bodiesNearErrors(), are solved while the scene
+  // is changing, so the time it takes depends on the size of that
+  // neighborhood instead of the whole scene.  The whole scene is solved
+  // when the change is finished.
+  Optional<int> maybe_changing_solve_hops;
+
+  // The fingerprint of the scene state after it was last fully solved.
+  // solveScene() doesn't solve again until the fingerprint changes, since
+  // many edits, such as renaming or changing a box, don't change anything
+  // that solving depends on.  This needs to be reset if the solve
+  // function changes.
+  Optional<SolveFingerprint> maybe_solved_fingerprint;
 
   ObservedScene(
     Scene &scene,
     TreeWidget &tree_widget,
     std::function<void(SceneState &)> update_errors_function,
-    std::function<void(SceneState &)> solve_function
+    std::function<SolveStats(SceneState &)> solve_function
   );
 
   BodyIndex addBody(Optional<BodyIndex> maybe_parent_index = {});
@@ -117,6 +157,7 @@ struct ObservedScene {
 
   void replaceSceneStateWith(const SceneState &);
   void solveScene();
+  const SolveStats *shownSolveStatsPtr() const;
   bool canPasteTo(Optional<BodyIndex>);
 
   static void
@@ -143,6 +184,7 @@ struct ObservedScene {
   void handleTreeBoolValueChanged(const TreePath &, bool);
   void handleSceneChanging();
   void handleSceneChanged();
+  void handleAsyncSolveFinished();
 
   static void
   createMarkerInScene(MarkerIndex marker_index, ObservedScene &observed_scene);
@@ -11,8 +11,10 @@
 #include "numericvaluelimits.hpp"
 #include "channel.hpp"
 #include "treevalues.hpp"
+#include "asyncsolver.hpp"
 
 using std::cerr;
+using std::string;
 using VariableName = SceneState::Variable::Name;
 
 
@@ -45,8 +47,11 @@ struct Tester {
   FakeTreeWidget tree_widget;
   FakeScene scene;
 
-  static void solveFunction(SceneState &)
+  static SolveStats solveFunction(SceneState &)
   {
+    SolveStats stats;
+    stats.n_iterations = 3;
+    return stats;
   }
 
   static void updateErrorsFunction(SceneState &)
@@ -1261,6 +1266,274 @@ static void testSettingChildBodyTransformValue()
 }
 
 
+static void testShowingSolveStats()
+{
+  Tester tester;
+  ObservedScene &observed_scene = tester.observed_scene;
+  const TreePath &total_error_path = observed_scene.tree_paths.total_error;
+  FakeTreeWidget &tree_widget = tester.tree_widget;
+  observed_scene.solveScene();
+  assert(observed_scene.solve_stats.n_iterations == 3);
+  observed_scene.handleSceneStateChanged();
+  string label = tree_widget.item(total_error_path).label_text;
+  assert(label.find("iterations") == string::npos);
+  observed_scene.show_solve_stats = true;
+  observed_scene.handleSceneStateChanged();
+  label = tree_widget.item(total_error_path).label_text;
+  assert(label.find("3 iterations") != string::npos);
+}
+
+
+// Sets each x translation that is being solved to 7.
+static SolveStats
+  solveXTranslations(SceneState &scene_state, const std::atomic<bool> &)
+{
+  for (auto body_index : indicesOf(scene_state.bodies())) {
+    SceneState::Body &body_state = scene_state.body(body_index);
+
+    if (body_state.solve_flags.translation.x) {
+      body_state.transform.translation.x = 7;
+    }
+  }
+
+  return SolveStats();
+}
+
+
+static void testSolvingAsynchronouslyWhileDragging()
+{
+  Tester tester;
+  ObservedScene &observed_scene = tester.observed_scene;
+  SceneState &scene_state = observed_scene.scene_state;
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool is_finished = false;
+
+  AsyncSolver async_solver(solveXTranslations, [&]{
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      is_finished = true;
+    }
+
+    condition.notify_one();
+  });
+
+  observed_scene.async_solver_ptr = &async_solver;
+  SceneState initial_state;
+  BodyIndex dragged_body_index = initial_state.createBody();
+  BodyIndex other_body_index = initial_state.createBody();
+  initial_state.body(dragged_body_index).solve_flags.translation.x = true;
+  initial_state.body(other_body_index).solve_flags.translation.x = true;
+  observed_scene.replaceSceneStateWith(initial_state);
+  userSelectsBody(dragged_body_index, tester);
+
+  SceneHandles::TransformHandle manipulator =
+    *observed_scene.scene_handles.maybe_translate_manipulator;
+
+  tester.scene.userTranslatesManipulator(manipulator, {1,0,0});
+  observed_scene.handleSceneChanging();
+
+  // The dragged body moves right away, and its solve flag is restored.
+  SceneState::Body &dragged_body = scene_state.body(dragged_body_index);
+  SceneState::Body &other_body = scene_state.body(other_body_index);
+  assert(dragged_body.transform.translation.x == 1);
+  assert(dragged_body.solve_flags.translation.x);
+
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [&]{ return is_finished; });
+  }
+
+  assert(other_body.transform.translation.x == 0);
+  observed_scene.handleAsyncSolveFinished();
+  assert(other_body.transform.translation.x == 7);
+  assert(dragged_body.transform.translation.x == 1);
+  observed_scene.async_solver_ptr = nullptr;
+}
+
+
+static void testUsingTheChangingSolveFunction()
+{
+  Tester tester;
+  ObservedScene &observed_scene = tester.observed_scene;
+  int n_changing_solves = 0;
+
+  observed_scene.changing_solve_function = [&](SceneState &){
+    ++n_changing_solves;
+    SolveStats stats;
+    stats.ran_out_of_budget = true;
+    return stats;
+  };
+
+  SceneState initial_state;
+  BodyIndex body_index = initial_state.createBody();
+  observed_scene.replaceSceneStateWith(initial_state);
+  userSelectsBody(body_index, tester);
+
+  SceneHandles::TransformHandle manipulator =
+    *observed_scene.scene_handles.maybe_translate_manipulator;
+
+  tester.scene.userTranslatesManipulator(manipulator, {1,0,0});
+  observed_scene.handleSceneChanging();
+  assert(n_changing_solves == 1);
+  assert(observed_scene.solve_stats.ran_out_of_budget);
+
+  // The full solve is done when the change is finished.
+  observed_scene.handleSceneChanged();
+  assert(n_changing_solves == 1);
+  assert(!observed_scene.solve_stats.ran_out_of_budget);
+}
+
+
+static void testPreviewingWhileDragging()
+{
+  Tester tester;
+  ObservedScene &observed_scene = tester.observed_scene;
+  int n_previews = 0;
+  bool preview_had_dragged_flag = false;
+  SceneState initial_state;
+  BodyIndex body_index = initial_state.createBody();
+  initial_state.body(body_index).solve_flags.translation.x = true;
+
+  observed_scene.changing_preview_function = [&](SceneState &state){
+    ++n_previews;
+
+    preview_had_dragged_flag =
+      state.body(body_index).solve_flags.translation.x;
+  };
+
+  observed_scene.replaceSceneStateWith(initial_state);
+  userSelectsBody(body_index, tester);
+
+  SceneHandles::TransformHandle manipulator =
+    *observed_scene.scene_handles.maybe_translate_manipulator;
+
+  tester.scene.userTranslatesManipulator(manipulator, {1,0,0});
+  observed_scene.handleSceneChanging();
+  assert(n_previews == 1);
+  assert(!preview_had_dragged_flag);
+  observed_scene.handleSceneChanged();
+  assert(n_previews == 1);
+}
+
+
+static void testSolvingOnlyNearTheManipulatedBody()
+{
+  Tester tester;
+  ObservedScene &observed_scene = tester.observed_scene;
+  vector<bool> solved_bodies;
+
+  observed_scene.changing_solve_function = [&](SceneState &state){
+    solved_bodies.clear();
+
+    for (auto body_index : indicesOf(state.bodies())) {
+      solved_bodies.push_back(state.body(body_index).solve_flags.scale);
+    }
+
+    return SolveStats();
+  };
+
+  observed_scene.maybe_changing_solve_hops = 1;
+
+  // A chain of bodies, each joined to the next by a distance error.
+  SceneState initial_state;
+  vector<BodyIndex> body_indices;
+
+  for (int i = 0; i != 3; ++i) {
+    body_indices.push_back(initial_state.createBody());
+    initial_state.body(body_indices.back()).solve_flags.scale = true;
+  }
+
+  for (int i = 0; i != 2; ++i) {
+    MarkerIndex marker1_index = initial_state.createMarker(body_indices[i]);
+
+    MarkerIndex marker2_index =
+      initial_state.createMarker(body_indices[i + 1]);
+
+    DistanceErrorIndex error_index = initial_state.createDistanceError();
+
+    SceneState::DistanceError &distance_error_state =
+      initial_state.distance_errors[error_index];
+
+    distance_error_state.setStart(Marker(marker1_index));
+    distance_error_state.setEnd(Marker(marker2_index));
+  }
+
+  observed_scene.replaceSceneStateWith(initial_state);
+  userSelectsBody(body_indices[0], tester);
+
+  SceneHandles::TransformHandle manipulator =
+    *observed_scene.scene_handles.maybe_translate_manipulator;
+
+  tester.scene.userTranslatesManipulator(manipulator, {1,0,0});
+  observed_scene.handleSceneChanging();
+  assert(solved_bodies == vector<bool>({true, true, false}));
+
+  // The flags are restored, so the whole scene is solved once the change
+  // is finished.
+  for (auto body_index : body_indices) {
+    assert(observed_scene.scene_state.body(body_index).solve_flags.scale);
+  }
+}
+
+
+static void testSkippingSolvesThatWouldChangeNothing()
+{
+  Tester tester;
+  ObservedScene &observed_scene = tester.observed_scene;
+  SceneState &scene_state = observed_scene.scene_state;
+  int n_solves = 0;
+
+  observed_scene.solve_function = [&](SceneState &){
+    ++n_solves;
+    return SolveStats();
+  };
+
+  SceneState initial_state;
+  BodyIndex body_index = initial_state.createBody();
+  BodyIndex other_body_index = initial_state.createBody();
+  BoxIndex box_index = initial_state.body(body_index).createBox();
+  MarkerIndex local_marker_index = initial_state.createMarker(body_index);
+  MarkerIndex global_marker_index = initial_state.createMarker();
+  DistanceErrorIndex error_index = initial_state.createDistanceError();
+
+  SceneState::DistanceError &distance_error_state =
+    initial_state.distance_errors[error_index];
+
+  distance_error_state.setStart(Marker(local_marker_index));
+  distance_error_state.setEnd(Marker(global_marker_index));
+  observed_scene.replaceSceneStateWith(initial_state);
+  observed_scene.solveScene();
+  assert(n_solves == 1);
+  observed_scene.solveScene();
+  assert(n_solves == 1);
+
+  // Nothing that the distance error depends on.
+  scene_state.body(body_index).name = "new_name";
+  scene_state.body(body_index).boxes[box_index].scale.x = 2;
+  scene_state.body(other_body_index).transform.translation.x = 3;
+  observed_scene.handleSceneChanged();
+  assert(n_solves == 1);
+
+  scene_state.body(body_index).solve_flags.translation.x = true;
+  observed_scene.handleSceneChanged();
+  assert(n_solves == 2);
+
+  scene_state.marker(global_marker_index).position.y = 1;
+  observed_scene.handleSceneChanged();
+  assert(n_solves == 3);
+
+  scene_state.distance_errors[error_index].weight = 2;
+  observed_scene.handleSceneChanged();
+  assert(n_solves == 4);
+
+  // A new scene is always solved.
+  observed_scene.replaceSceneStateWith(initial_state);
+  observed_scene.solveScene();
+  assert(n_solves == 5);
+}
+
+
 static void testHandleSceneStateChanged()
 {
   Tester tester;
@@ -1526,6 +1799,12 @@ int main()
   testTransferringABody2();
   testTransferringAMarker();
   testHandleSceneStateChanged();
+  testShowingSolveStats();
+  testSolvingAsynchronouslyWhileDragging();
+  testUsingTheChangingSolveFunction();
+  testSkippingSolvesThatWouldChangeNothing();
+  testSolvingOnlyNearTheManipulatedBody();
+  testPreviewingWhileDragging();
   testDuplicateBody();
   testDuplicateBodyWhenTheBodyHasExpressions();
   testDuplicateBodyWithDistanceErrors();
@@ -29,8 +29,15 @@ static bool reduceStep(float &step)
 }
 
 
-static float optimizeVar(const FunctionInterface &f, float &var, float error)
+static float
+  optimizeVar(
+    const FunctionInterface &f,
+    vector<float> &variables,
+    size_t var_index,
+    float error
+  )
 {
+  float &var = variables[var_index];
   float step = min_step;
 
   for (;;) {
@@ -38,9 +45,9 @@ static float optimizeVar(const FunctionInterface &f, float &var, float error)
     float forward_value = var+step;
     float reverse_value = var-step;
     var = forward_value;
-    float forward_error = f();
+    float forward_error = f(var_index);
     var = reverse_value;
-    float reverse_error = f();
+    float reverse_error = f(var_index);
     var = old_var;
 
     if (forward_error >= error && reverse_error >= error) {
@@ -73,10 +80,16 @@ float minimizeImpl(const FunctionInterface &f,vector<float> &variables)
   for (;;) {
     float error_before_optimizing = error;
 
-    for (auto &variable : variables) {
-      error = optimizeVar(f,variable,error);
+    for (size_t i = 0; i != variables.size(); ++i) {
+      if (f.shouldStop()) {
+        return error;
+      }
+
+      error = optimizeVar(f,variables,i,error);
     }
 
+    f.iterationFinished(error);
+
     if (error == error_before_optimizing) {
       break;
     }
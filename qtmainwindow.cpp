@@ -129,6 +129,14 @@ Optional<string> QtMainWindow::View::askForOpenPath()
 }
 
 
+void QtMainWindow::View::callOnGuiThread(std::function<void()> f)
+{
+  // The queued call is run by the main window's event loop, and is
+  // dropped if the window has been destroyed by then.
+  QMetaObject::invokeMethod(&main_window, std::move(f), Qt::QueuedConnection);
+}
+
+
 QtMainWindow::QtMainWindow()
 : splitter(createCentralWidget<QSplitter>(*this)),
   tree_widget(createTree(splitter)),
@@ -21,6 +21,7 @@ class QtMainWindow : public QMainWindow {
       Optional<FilePath> askForOpenPath() override;
       TreeWidget &treeWidget() override { return main_window.tree_widget; }
       Scene &scene() override { return main_window.scene; }
+      void callOnGuiThread(std::function<void()>) override;
     };
 
     OSGScene scene;
@@ -1,6 +1,7 @@
 #ifndef ROTATIONVECTOR_HPP_
 #define ROTATIONVECTOR_HPP_
 
+#include <limits>
 #include "eigenconv.hpp"
 
 
@@ -39,4 +40,77 @@ inline Eigen::Matrix3f makeRotation(const Vec3 &rotation_vector)
 }
 
 
+inline Eigen::Matrix3f crossProductMatrix(const Eigen::Vector3f &v)
+{
+  Eigen::Matrix3f result;
+  result <<
+       0, -v.z(),  v.y(),
+   v.z(),      0, -v.x(),
+  -v.y(),  v.x(),      0;
+  return result;
+}
+
+
+// Changing a rotation vector v by a small amount d changes the rotation
+// makeRotation(v) by a rotation of rotationVectorJacobian(v)*d, so the
+// derivative of makeRotation(v)*p with respect to v is
+// -crossProductMatrix(makeRotation(v)*p)*rotationVectorJacobian(v).
+inline Eigen::Matrix3f rotationVectorJacobian(const Vec3 &rotation_vector)
+{
+  Eigen::Vector3f v = eigenVector3f(rotation_vector);
+  float angle = v.norm();
+  float a, b;
+
+  if (angle < 1e-2) {
+    // Use the series expansion near zero to avoid cancellation.
+    float angle2 = angle*angle;
+    a = 0.5f - angle2/24;
+    b = 1.0f/6 - angle2/120;
+  }
+  else {
+    float angle2 = angle*angle;
+    a = (1 - std::cos(angle))/angle2;
+    b = (angle - std::sin(angle))/(angle2*angle);
+  }
+
+  Eigen::Matrix3f k = crossProductMatrix(v);
+  return Eigen::Matrix3f::Identity() + a*k + b*k*k;
+}
+
+
+// A rotation matrix along with the rotation vector, in degrees, that it was
+// made from, so that the matrix is only remade when the rotation changes.
+// The rotation vector jacobian is only made when it is asked for.
+struct CachedRotation {
+  // Since NaN is never equal to anything, the first update always makes
+  // the matrix.
+  static constexpr float nan = std::numeric_limits<float>::quiet_NaN();
+  Vec3 rotation_deg{nan, nan, nan};
+  Eigen::Matrix3f matrix;
+  Eigen::Matrix3f vector_jacobian;
+  bool has_vector_jacobian = false;
+
+  const Eigen::Matrix3f &update(const Vec3 &new_rotation_deg)
+  {
+    if (new_rotation_deg != rotation_deg) {
+      rotation_deg = new_rotation_deg;
+      matrix = makeRotation(new_rotation_deg*(M_PI/180));
+      has_vector_jacobian = false;
+    }
+
+    return matrix;
+  }
+
+  const Eigen::Matrix3f &vectorJacobian()
+  {
+    if (!has_vector_jacobian) {
+      vector_jacobian = rotationVectorJacobian(rotation_deg*(M_PI/180));
+      has_vector_jacobian = true;
+    }
+
+    return vector_jacobian;
+  }
+};
+
+
 #endif /* ROTATIONVECTOR_HPP_ */
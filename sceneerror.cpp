@@ -51,16 +51,19 @@ static float distanceBetween(const Point &a,const Point &b)
 static Point
 pointPredicted(
   const PointLink &point,
-  SceneState &scene_state
+  const SceneState &scene_state,
+  GlobalTransformCache &cache
 )
 {
   if (point.maybe_marker) {
     MarkerIndex marker_index = point.maybe_marker->index;
-    return markerPredicted(scene_state, marker_index);
+    return markerPredicted(scene_state, marker_index, cache);
   }
   else if (point.maybe_body_mesh_position) {
     return
-      bodyMeshPositionPredicted(scene_state, *point.maybe_body_mesh_position);
+      bodyMeshPositionPredicted(
+        scene_state, *point.maybe_body_mesh_position, cache
+      );
   }
   else {
     assert(false); // not implemented
@@ -71,7 +74,8 @@ pointPredicted(
 static void
   updateDistanceErrorInState(
     SceneState::DistanceError &distance_error,
-    SceneState &scene_state
+    SceneState &scene_state,
+    GlobalTransformCache &cache
   )
 {
   bool have_both_markers = distance_error.hasStart() && distance_error.hasEnd();
@@ -84,10 +88,10 @@ static void
   }
 
   const PointLink &start_point = *distance_error.optional_start;
-  Point start_predicted = pointPredicted(start_point, scene_state);
+  Point start_predicted = pointPredicted(start_point, scene_state, cache);
 
   const PointLink &end_point = *distance_error.optional_end;
-  Point end_predicted = pointPredicted(end_point, scene_state);
+  Point end_predicted = pointPredicted(end_point, scene_state, cache);
 
   float distance = distanceBetween(start_predicted, end_predicted);
   float desired_distance = distance_error.desired_distance;
@@ -97,13 +101,26 @@ static void
 }
 
 
-void updateErrorsInState(SceneState &scene_state)
+void
+  updateDistanceErrorInState(
+    SceneState &scene_state,
+    DistanceErrorIndex distance_error_index,
+    GlobalTransformCache &cache
+  )
+{
+  updateDistanceErrorInState(
+    scene_state.distance_errors[distance_error_index], scene_state, cache
+  );
+}
+
+
+void updateErrorsInState(SceneState &scene_state, GlobalTransformCache &cache)
 {
   float total_error = 0;
 
   for (auto i : indicesOf(scene_state.distance_errors)) {
     SceneState::DistanceError &distance_error = scene_state.distance_errors[i];
-    updateDistanceErrorInState(distance_error, scene_state);
+    updateDistanceErrorInState(distance_error, scene_state, cache);
     total_error += distance_error.error;
   }
 
@@ -111,7 +128,167 @@ void updateErrorsInState(SceneState &scene_state)
 }
 
 
+void updateErrorsInState(SceneState &scene_state)
+{
+  GlobalTransformCache cache(scene_state);
+  updateErrorsInState(scene_state, cache);
+}
+
+
 float sceneError(const SceneState &scene_state)
 {
   return scene_state.total_error;
 }
+
+
+static Point
+pointPredictedWithDerivatives(
+  const PointLink &point,
+  const SceneState &scene_state,
+  GlobalTransformCache &cache,
+  vector<BodyTransformDerivatives> &derivatives
+)
+{
+  if (point.maybe_marker) {
+    MarkerIndex marker_index = point.maybe_marker->index;
+
+    return
+      markerPredictedWithDerivatives(
+        scene_state, marker_index, cache, derivatives
+      );
+  }
+  else if (point.maybe_body_mesh_position) {
+    return
+      bodyMeshPositionPredictedWithDerivatives(
+        scene_state, *point.maybe_body_mesh_position, cache, derivatives
+      );
+  }
+  else {
+    assert(false); // not implemented
+  }
+}
+
+
+static void
+  addPointDerivatives(
+    const PointLink &point,
+    const vector<BodyTransformDerivatives> &point_derivatives,
+    const Eigen::Matrix3f &projection,
+    const SceneState &scene_state,
+    GlobalTransformCache &cache,
+    ResidualDerivatives &derivatives
+  )
+{
+  for (const BodyTransformDerivatives &body_derivatives : point_derivatives) {
+    derivatives.bodies.push_back(
+      ResidualBodyDerivatives{
+        body_derivatives.body_index,
+        projection*body_derivatives.translation,
+        projection*body_derivatives.rotation,
+        projection*body_derivatives.scale
+      }
+    );
+  }
+
+  if (point.maybe_body_mesh_position) {
+    BodyMeshPosition body_mesh_position = *point.maybe_body_mesh_position;
+
+    Eigen::Matrix3f scale_derivatives =
+      bodyMeshPositionScaleDerivatives(
+        scene_state, body_mesh_position, cache
+      );
+
+    derivatives.meshes.push_back(
+      ResidualMeshDerivatives{
+        body_mesh_position.array.body_mesh,
+        projection*scale_derivatives
+      }
+    );
+  }
+}
+
+
+int distanceErrorResidualCount(const SceneState::DistanceError &distance_error)
+{
+  if (!distance_error.hasStart() || !distance_error.hasEnd()) {
+    return 0;
+  }
+
+  if (distance_error.desired_distance == 0) {
+    return 3;
+  }
+
+  return 1;
+}
+
+
+void
+evaluateDistanceErrorResiduals(
+  const SceneState::DistanceError &distance_error,
+  const SceneState &scene_state,
+  GlobalTransformCache &cache,
+  Eigen::Vector3f &residuals,
+  ResidualDerivatives *derivatives_ptr
+)
+{
+  int n_residuals = distanceErrorResidualCount(distance_error);
+
+  if (n_residuals == 0) {
+    return;
+  }
+
+  const PointLink &start_point = *distance_error.optional_start;
+  const PointLink &end_point = *distance_error.optional_end;
+  vector<BodyTransformDerivatives> start_derivatives;
+  vector<BodyTransformDerivatives> end_derivatives;
+  Point start_predicted, end_predicted;
+
+  if (derivatives_ptr) {
+    start_predicted =
+      pointPredictedWithDerivatives(
+        start_point, scene_state, cache, start_derivatives
+      );
+
+    end_predicted =
+      pointPredictedWithDerivatives(
+        end_point, scene_state, cache, end_derivatives
+      );
+  }
+  else {
+    start_predicted = pointPredicted(start_point, scene_state, cache);
+    end_predicted = pointPredicted(end_point, scene_state, cache);
+  }
+
+  float weight_root = sqrt(distance_error.weight);
+  Vector3f delta = start_predicted - end_predicted;
+
+  // The projection maps changes in the point positions to changes in the
+  // residuals.
+  Eigen::Matrix3f projection = Eigen::Matrix3f::Zero();
+
+  if (n_residuals == 3) {
+    residuals = delta*weight_root;
+    projection.diagonal().setConstant(weight_root);
+  }
+  else {
+    float distance = delta.norm();
+    float desired_distance = distance_error.desired_distance;
+    residuals[0] = (distance - desired_distance)*weight_root;
+
+    if (distance != 0) {
+      projection.row(0) = delta.transpose()*(weight_root/distance);
+    }
+  }
+
+  if (derivatives_ptr) {
+    addPointDerivatives(
+      start_point, start_derivatives, projection, scene_state, cache,
+      *derivatives_ptr
+    );
+
+    addPointDerivatives(
+      end_point, end_derivatives, -projection, scene_state, cache,
+      *derivatives_ptr
+    );
+  }
+}
@@ -1,4 +1,71 @@
+#ifndef SCENEERROR_HPP_
+#define SCENEERROR_HPP_
+
 #include "scenestate.hpp"
+#include "globaltransform.hpp"
 
 extern float sceneError(const SceneState &);
 extern void updateErrorsInState(SceneState &scene_state);
+
+// The cache must be up to date with the scene state.
+extern void updateErrorsInState(SceneState &, GlobalTransformCache &);
+
+// Updates a single distance error without updating the total error.
+extern void
+  updateDistanceErrorInState(
+    SceneState &,
+    DistanceErrorIndex,
+    GlobalTransformCache &
+  );
+
+
+// Derivatives of the residuals of a distance error with respect to the
+// values of a body's transform.  Each row is for one residual, and the
+// rotation derivatives are per radian.
+struct ResidualBodyDerivatives {
+  BodyIndex body_index;
+  Eigen::Matrix3f translation;
+  Eigen::Matrix3f rotation;
+  Eigen::Vector3f scale;
+};
+
+
+struct ResidualMeshDerivatives {
+  BodyMesh body_mesh;
+  Eigen::Matrix3f scale;
+};
+
+
+struct ResidualDerivatives {
+  vector<ResidualBodyDerivatives> bodies;
+  vector<ResidualMeshDerivatives> meshes;
+
+  void clear()
+  {
+    bodies.clear();
+    meshes.clear();
+  }
+};
+
+
+// A distance error has a single residual, which is the weighted difference
+// between the distance and the desired distance, except when the desired
+// distance is zero, where we use the three weighted differences of the
+// coordinates instead, since they are smooth.  Either way, the sum of the
+// squares of the residuals is the error.  Distance errors without both
+// points don't have residuals.
+extern int distanceErrorResidualCount(const SceneState::DistanceError &);
+
+// Sets the first distanceErrorResidualCount() residuals, and appends the
+// derivatives if derivatives_ptr is not null.  The cache must be up to
+// date with the scene state.
+extern void
+  evaluateDistanceErrorResiduals(
+    const SceneState::DistanceError &,
+    const SceneState &,
+    GlobalTransformCache &,
+    Eigen::Vector3f &residuals,
+    ResidualDerivatives *derivatives_ptr = nullptr
+  );
+
+#endif /* SCENEERROR_HPP_ */
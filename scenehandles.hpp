@@ -19,6 +19,28 @@ struct OptionalManipulatedElement {
 };
 
 
+// The value that a scene object was last set to from the scene state, so
+// that setting it again can be skipped when the state hasn't changed.
+// Anything that sets the object some other way needs to forget the value.
+template <typename T>
+struct ShownValue {
+  Optional<T> maybe_value;
+
+  // Returns whether the object needs to be set to the value.
+  bool change(const T &value)
+  {
+    if (maybe_value && *maybe_value == value) {
+      return false;
+    }
+
+    maybe_value = value;
+    return true;
+  }
+
+  void forget() { maybe_value.reset(); }
+};
+
+
 struct SceneHandles {
   struct Marker;
   struct Body;
@@ -32,14 +54,20 @@ struct SceneHandles {
 
   struct Box {
     GeometryHandle handle;
+    ShownValue<Vec3> shown_scale = {};
+    ShownValue<Vec3> shown_center = {};
   };
 
   struct Line {
     LineHandle handle;
+    ShownValue<Vec3> shown_start = {};
+    ShownValue<Vec3> shown_end = {};
   };
 
   struct Mesh {
     MeshHandle handle;
+    ShownValue<Vec3> shown_scale = {};
+    ShownValue<Vec3> shown_center = {};
   };
 
   struct Body {
@@ -48,6 +76,11 @@ struct SceneHandles {
     vector<Line> lines;
     vector<Mesh> meshes;
 
+    // The rotation is in degrees, and the translation is scaled by the
+    // global scale of the parent.
+    ShownValue<Vec3> shown_rotation;
+    ShownValue<Vec3> shown_translation;
+
     Body(TransformHandle transform_handle)
     : transform_handle(transform_handle)
     {
@@ -76,6 +109,7 @@ struct SceneHandles {
     TransformHandle transform_handle;
     GeometryHandle sphere_handle;
     public:
+    ShownValue<Vec3> shown_translation;
 
     Marker(TransformHandle transform_handle, GeometryHandle sphere_handle)
     : transform_handle(transform_handle),
@@ -90,6 +124,8 @@ struct SceneHandles {
   struct DistanceError {
     Scene::TransformHandle transform_handle;
     Scene::LineHandle line_handle;
+    ShownValue<Vec3> shown_start = {};
+    ShownValue<Vec3> shown_end = {};
   };
 
   Optional<TransformHandle> maybe_translate_manipulator;
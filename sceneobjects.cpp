@@ -2,7 +2,7 @@
 
 #include <iostream>
 #include <float.h>
-#include "settransform.hpp"
+#include "rotationvector.hpp"
 #include "indicesof.hpp"
 #include "removeindexfrom.hpp"
 #include "transformstate.hpp"
@@ -301,11 +301,11 @@ static void
 updateDistanceErrorInScene(
   Scene &scene,
   const SceneState &scene_state,
-  const SceneHandles &scene_handles,
+  SceneHandles &scene_handles,
   DistanceErrorIndex distance_error_index
 )
 {
-  const SceneHandles::DistanceError &distance_error_handles =
+  SceneHandles::DistanceError &distance_error_handles =
     scene_handles.distance_errors[distance_error_index];
 
   const SceneState::DistanceError &distance_error_state =
@@ -323,13 +323,16 @@ updateDistanceErrorInScene(
     end = pointPredicted(*distance_error_state.optional_end, scene_state);
   }
 
-  scene.setLineStartPoint(
-    distance_error_handles.line_handle, makeScenePointFromPoint(start)
-  );
+  Scene::Point scene_start = makeScenePointFromPoint(start);
+  Scene::Point scene_end = makeScenePointFromPoint(end);
 
-  scene.setLineEndPoint(
-    distance_error_handles.line_handle, makeScenePointFromPoint(end)
-  );
+  if (distance_error_handles.shown_start.change(scene_start)) {
+    scene.setLineStartPoint(distance_error_handles.line_handle, scene_start);
+  }
+
+  if (distance_error_handles.shown_end.change(scene_end)) {
+    scene.setLineEndPoint(distance_error_handles.line_handle, scene_end);
+  }
 }
 
 
@@ -522,18 +525,20 @@ static void
 updateBoxInScene(
   Scene &scene,
   const SceneState::Box &box_state,
-  const SceneHandles::Box &box_handles,
+  SceneHandles::Box &box_handles,
   SceneState::Float body_global_scale
 )
 {
-  scene.setGeometryScale(
-    box_handles.handle, vec3FromXYZState(box_state.scale) * body_global_scale
-  );
+  Vec3 scale = vec3FromXYZState(box_state.scale) * body_global_scale;
+  Vec3 center = vec3FromXYZState(box_state.center)*body_global_scale;
 
-  scene.setGeometryCenter(
-    box_handles.handle,
-    vec3FromXYZState(box_state.center)*body_global_scale
-  );
+  if (box_handles.shown_scale.change(scale)) {
+    scene.setGeometryScale(box_handles.handle, scale);
+  }
+
+  if (box_handles.shown_center.change(center)) {
+    scene.setGeometryCenter(box_handles.handle, center);
+  }
 }
 
 
@@ -541,17 +546,20 @@ static void
 updateLineInScene(
   Scene &scene,
   const SceneState::Line &line_state,
-  const SceneHandles::Line &line_handles,
+  SceneHandles::Line &line_handles,
   SceneState::Float body_global_scale
 )
 {
-  scene.setLineStartPoint(
-    line_handles.handle, vec3FromXYZState(line_state.start)*body_global_scale
-  );
+  Vec3 start = vec3FromXYZState(line_state.start)*body_global_scale;
+  Vec3 end = vec3FromXYZState(line_state.end)*body_global_scale;
 
-  scene.setLineEndPoint(
-    line_handles.handle, vec3FromXYZState(line_state.end)*body_global_scale
-  );
+  if (line_handles.shown_start.change(start)) {
+    scene.setLineStartPoint(line_handles.handle, start);
+  }
+
+  if (line_handles.shown_end.change(end)) {
+    scene.setLineEndPoint(line_handles.handle, end);
+  }
 }
 
 
@@ -559,44 +567,47 @@ void
 updateMeshInScene(
   Scene &scene,
   const SceneState::Mesh &mesh_state,
-  const SceneHandles::Mesh &mesh_handles,
+  SceneHandles::Mesh &mesh_handles,
   SceneState::Float body_global_scale
 )
 {
-  scene.setGeometryScale(
-    mesh_handles.handle, vec3FromXYZState(mesh_state.scale) * body_global_scale
-  );
+  Vec3 scale = vec3FromXYZState(mesh_state.scale) * body_global_scale;
+  Vec3 center = vec3FromXYZState(mesh_state.center) * body_global_scale;
 
-  scene.setGeometryCenter(
-    mesh_handles.handle, vec3FromXYZState(mesh_state.center) * body_global_scale
-  );
+  if (mesh_handles.shown_scale.change(scale)) {
+    scene.setGeometryScale(mesh_handles.handle, scale);
+  }
+
+  if (mesh_handles.shown_center.change(center)) {
+    scene.setGeometryCenter(mesh_handles.handle, center);
+  }
 }
 
 
 namespace {
 struct GeometrySceneUpdater {
-  const SceneHandles::Body &body_handles;
+  SceneHandles::Body &body_handles;
   const SceneState::Body &body_state;
   Scene &scene;
   const float body_global_scale;
 
   void visitBox(BoxIndex box_index)
   {
-    const SceneHandles::Box &box_handles = body_handles.boxes[box_index];
+    SceneHandles::Box &box_handles = body_handles.boxes[box_index];
     const SceneState::Box &box_state = body_state.boxes[box_index];
     updateBoxInScene(scene, box_state, box_handles, body_global_scale);
   }
 
   void visitLine(LineIndex line_index)
   {
-    const SceneHandles::Line &line_handles = body_handles.lines[line_index];
+    SceneHandles::Line &line_handles = body_handles.lines[line_index];
     const SceneState::Line &line_state = body_state.lines[line_index];
     updateLineInScene(scene, line_state, line_handles, body_global_scale);
   }
 
   void visitMesh(MeshIndex mesh_index)
   {
-    const SceneHandles::Mesh &mesh_handles = body_handles.meshes[mesh_index];
+    SceneHandles::Mesh &mesh_handles = body_handles.meshes[mesh_index];
     const SceneState::Mesh &mesh_state = body_state.meshes[mesh_index];
     updateMeshInScene(scene, mesh_state, mesh_handles, body_global_scale);
   }
@@ -609,11 +620,11 @@ updateBodyInScene(
   Scene &scene,
   BodyIndex body_index,
   const SceneState &scene_state,
-  const SceneHandles &scene_handles
+  SceneHandles &scene_handles
 )
 {
   const SceneState::Body &body_state = scene_state.body(body_index);
-  const SceneHandles::Body &body_handles = *scene_handles.bodies[body_index];
+  SceneHandles::Body &body_handles = *scene_handles.bodies[body_index];
   float parent_global_scale = 1;
 
   if (body_state.maybe_parent_index) {
@@ -622,14 +633,21 @@ updateBodyInScene(
   }
 
   float body_global_scale = parent_global_scale * body_state.transform.scale;
+  Vec3 rotation = rotationValuesDeg(body_state.transform);
 
-  setTransform(
-    body_handles.transformHandle(),
-    makeUnscaledTransformFromState(
-      body_state.transform, parent_global_scale
-    ),
-    scene
-  );
+  Vec3 translation =
+    translationValues(body_state.transform) * parent_global_scale;
+
+  if (body_handles.shown_rotation.change(rotation)) {
+    scene.setCoordinateAxes(
+      body_handles.transformHandle(),
+      coordinateAxes(makeRotation(rotation*(M_PI/180)))
+    );
+  }
+
+  if (body_handles.shown_translation.change(translation)) {
+    scene.setTranslation(body_handles.transformHandle(), translation);
+  }
 
   assert(body_handles.boxes.size() == body_state.boxes.size());
 
@@ -1092,7 +1110,7 @@ destroySceneObjects(
 static void
   updateDistanceErrorsInScene(
     Scene &scene,
-    const SceneHandles &scene_handles,
+    SceneHandles &scene_handles,
     const SceneState &scene_state
   )
 {
@@ -1258,24 +1276,24 @@ updateBodyMeshStateFromScaleManipulator(
 static void
 updateMarkerInScene(
   Scene &scene,
-  const SceneHandles &scene_handles,
+  SceneHandles &scene_handles,
   const SceneState &scene_state,
   MarkerIndex marker_index
 )
 {
   Vec3 translation = markerTranslation(marker_index, scene_state);
+  SceneHandles::Marker &marker_handles = scene_handles.marker(marker_index);
 
-  const SceneHandles::Marker &marker_handles =
-    scene_handles.marker(marker_index);
-
-  scene.setTranslation(marker_handles.transformHandle(), translation);
+  if (marker_handles.shown_translation.change(translation)) {
+    scene.setTranslation(marker_handles.transformHandle(), translation);
+  }
 }
 
 
 static void
 updateMarkersInScene(
   Scene &scene,
-  const SceneHandles &scene_handles,
+  SceneHandles &scene_handles,
   const SceneState &scene_state
 )
 {
@@ -1289,7 +1307,7 @@ static void
 updateBodiesInScene(
   Scene &scene,
   const SceneState &state,
-  const SceneHandles &scene_handles
+  SceneHandles &scene_handles
 )
 {
   for (auto body_index : indicesOf(state.bodies())) {
@@ -1382,7 +1400,7 @@ updateManipulatorsInScene(
 void
   updateSceneObjects(
     Scene &scene,
-    const SceneHandles &scene_handles,
+    SceneHandles &scene_handles,
     const SceneState &state
   )
 {
@@ -1393,6 +1411,48 @@ void
 }
 
 
+void forgetManipulatedElementValues(SceneHandles &scene_handles)
+{
+  const OptionalManipulatedElement &element =
+    scene_handles.maybe_manipulated_element;
+
+  if (element.maybe_body_index) {
+    SceneHandles::Body &body_handles =
+      scene_handles.body(*element.maybe_body_index);
+
+    body_handles.shown_rotation.forget();
+    body_handles.shown_translation.forget();
+  }
+
+  if (element.maybe_marker_index) {
+    SceneHandles::Marker &marker_handles =
+      scene_handles.marker(*element.maybe_marker_index);
+
+    marker_handles.shown_translation.forget();
+  }
+
+  if (element.maybe_body_box) {
+    BodyBox body_box = *element.maybe_body_box;
+
+    SceneHandles::Box &box_handles =
+      scene_handles.body(body_box.body.index).boxes[body_box.index];
+
+    box_handles.shown_scale.forget();
+    box_handles.shown_center.forget();
+  }
+
+  if (element.maybe_body_mesh) {
+    BodyMesh body_mesh = *element.maybe_body_mesh;
+
+    SceneHandles::Mesh &mesh_handles =
+      scene_handles.body(body_mesh.body.index).meshes[body_mesh.index];
+
+    mesh_handles.shown_scale.forget();
+    mesh_handles.shown_center.forget();
+  }
+}
+
+
 void
 updateBodyMeshPositionInScene(
   BodyIndex body_index,
@@ -29,13 +29,20 @@ extern void
     const SceneState &
   );
 
+// Only sets the scene objects whose values have changed since they were
+// last updated.
 extern void
   updateSceneObjects(
     Scene &scene,
-    const SceneHandles &scene_handles,
+    SceneHandles &scene_handles,
     const SceneState &state
   );
 
+// The manipulators set the scene objects of the manipulated element
+// directly, so they need to be set again on the next update, even if the
+// scene state ends up with the same values as before.
+extern void forgetManipulatedElementValues(SceneHandles &);
+
 extern void
   removeDistanceErrorFromScene(
     Scene &scene,
@@ -232,7 +239,7 @@ extern void
   updateMeshInScene(
     Scene &scene,
     const SceneState::Mesh &mesh_state,
-    const SceneHandles::Mesh &mesh_handles,
+    SceneHandles::Mesh &mesh_handles,
     SceneState::Float body_global_scale
   );
 
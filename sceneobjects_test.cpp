@@ -22,6 +22,43 @@ sceneGeometryCenter(
 }
 
 
+static void testOnlySettingChangedObjects()
+{
+  FakeScene scene;
+  SceneState state;
+  BodyIndex body_index = state.createBody(/*parent*/{});
+  state.body(body_index).createBox();
+  Scene::Point center = {1, 2, 3};
+  state.body(body_index).boxes[0].center = xyzStateFromVec3(center);
+  SceneHandles scene_handles = createSceneObjects(state, scene);
+  updateSceneObjects(scene, scene_handles, state);
+
+  // The state hasn't changed, so updating doesn't set the box again.
+  Scene::GeometryHandle box_handle =
+    scene_handles.body(body_index).boxes[0].handle;
+
+  Scene::Point other_center = {4, 5, 6};
+  scene.setGeometryCenter(box_handle, other_center);
+  updateSceneObjects(scene, scene_handles, state);
+  assert(sceneGeometryCenter(body_index, scene, scene_handles) == other_center);
+
+  // Once the values of the box are forgotten, it is set again.
+  scene_handles.maybe_manipulated_element.maybe_body_box =
+    BodyBox{body_index, 0};
+
+  forgetManipulatedElementValues(scene_handles);
+  updateSceneObjects(scene, scene_handles, state);
+  assert(sceneGeometryCenter(body_index, scene, scene_handles) == center);
+
+  // Changing the state sets the box.
+  Scene::Point new_center = {7, 8, 9};
+  state.body(body_index).boxes[0].center = xyzStateFromVec3(new_center);
+  updateSceneObjects(scene, scene_handles, state);
+  assert(sceneGeometryCenter(body_index, scene, scene_handles) == new_center);
+  destroySceneObjects(scene, state, scene_handles);
+}
+
+
 int main()
 {
   FakeScene scene;
@@ -37,4 +74,5 @@ int main()
   assert(sceneGeometryCenter(child_index, scene, scene_handles) == center);
   destroySceneObjects(scene, state, scene_handles);
   assert(scene.objects.empty());
+  testOnlySettingChangedObjects();
 }
@@ -1,5 +1,9 @@
 #include "scenesolver.hpp"
 
+#include <memory>
+#include <algorithm>
+#include <chrono>
+#include <limits>
 #include "sceneerror.hpp"
 #include "vec3.hpp"
 #include "optimize.hpp"
@@ -8,8 +12,84 @@
 #include "transformstate.hpp"
 #include "indicesof.hpp"
 #include "solveflags.hpp"
+#include "leastsquares.hpp"
+#include "solvegraph.hpp"
+#include "threadpool.hpp"
+#include "solveplan.hpp"
+#include "globaltransform.hpp"
+#include "positionstate.hpp"
 
 using std::cerr;
+using Clock = std::chrono::steady_clock;
+
+static double secondsSince(Clock::time_point start_time)
+{
+  return std::chrono::duration<double>(Clock::now() - start_time).count();
+}
+
+
+static bool isCancelled(const std::atomic<bool> *cancel_flag_ptr)
+{
+  return cancel_flag_ptr && *cancel_flag_ptr;
+}
+
+
+// When a solve should stop before it has converged.
+namespace {
+struct SolveLimits {
+  const std::atomic<bool> *cancel_flag_ptr = nullptr;
+  Optional<Clock::time_point> maybe_deadline;
+  Optional<int> maybe_max_evaluations;
+
+  SolveLimits(const SolveOptions &options, Clock::time_point start_time)
+  : cancel_flag_ptr(options.cancel_flag_ptr),
+    maybe_max_evaluations(options.maybe_evaluation_budget)
+  {
+    if (options.maybe_time_budget_seconds) {
+      maybe_deadline =
+        start_time +
+        std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double>(*options.maybe_time_budget_seconds)
+        );
+    }
+  }
+
+  bool reached(SolveStats &stats) const
+  {
+    if (isCancelled(cancel_flag_ptr)) {
+      return true;
+    }
+
+    bool is_over_budget =
+      (maybe_max_evaluations && stats.n_evaluations >= *maybe_max_evaluations)
+      || (maybe_deadline && Clock::now() >= *maybe_deadline);
+
+    if (is_over_budget) {
+      stats.ran_out_of_budget = true;
+    }
+
+    return is_over_budget;
+  }
+
+  // The limits for continuing a solve that has already evaluated the
+  // error n_evaluations times.
+  SolveLimits afterEvaluations(int n_evaluations) const
+  {
+    SolveLimits result = *this;
+
+    if (maybe_max_evaluations) {
+      result.maybe_max_evaluations = *maybe_max_evaluations - n_evaluations;
+    }
+
+    return result;
+  }
+};
+}
+
+
+// With this many variables, most of the jacobian is zero, since each
+// distance error only depends on the bodies above its two points.
+static const size_t min_sparse_variables = 60;
 
 
 static void
@@ -62,10 +142,10 @@ static void
 }
 
 
-template <typename F>
+template <typename XYZ, typename F>
 static void
 visitSolvableComponent(
-  SceneState::XYZ &xyz_values,
+  XYZ &xyz_values,
   const SceneState::XYZSolveFlags &xyz_solve_flags,
   XYZComponent component,
   const F &f2
@@ -184,25 +264,1853 @@ static void updateState(SceneState &scene_state, const vector<float> &variables)
 }
 
 
-void solveScene(SceneState &scene_state)
+namespace {
+struct XYZVariableIndices {
+  Optional<size_t> x, y, z;
+};
+}
+
+
+namespace {
+struct BodyVariableIndices {
+  XYZVariableIndices translation;
+  XYZVariableIndices rotation;
+  Optional<size_t> scale;
+  vector<XYZVariableIndices> mesh_scales;
+};
+}
+
+
+namespace {
+struct VariableIndices {
+  vector<BodyVariableIndices> bodies;
+  size_t n_variables = 0;
+
+  Optional<size_t> next(bool solve)
+  {
+    if (!solve) {
+      return {};
+    }
+
+    return n_variables++;
+  }
+};
+}
+
+
+// The indices are assigned in the same order as forEachSceneValue().
+static VariableIndices variableIndices(const SceneState &scene_state)
 {
-  vector<float> variables;
+  VariableIndices result;
+
+  for (auto body_index : indicesOf(scene_state.bodies())) {
+    const SceneState::Body &body_state = scene_state.body(body_index);
+    const SceneState::TransformSolveFlags &solve_flags = body_state.solve_flags;
+    result.bodies.emplace_back();
+    BodyVariableIndices &body_indices = result.bodies.back();
+
+    struct Visitor {
+      const SceneState::TransformSolveFlags &solve_flags;
+      BodyVariableIndices &body_indices;
+      VariableIndices &result;
+
+      void visitTranslationComponent(XYZComponent c) const
+      {
+        component(body_indices.translation, c) =
+          result.next(solve_flags.translation.component(c));
+      }
+
+      void visitRotationComponent(XYZComponent c) const
+      {
+        component(body_indices.rotation, c) =
+          result.next(solve_flags.rotation.component(c));
+      }
+
+      void visitScale() const
+      {
+        body_indices.scale = result.next(solve_flags.scale);
+      }
+    };
+
+    forEachSolvableTransformElement(
+      Visitor{solve_flags, body_indices, result}
+    );
+
+    for (auto &mesh_state : body_state.meshes) {
+      body_indices.mesh_scales.emplace_back();
+      XYZVariableIndices &mesh_indices = body_indices.mesh_scales.back();
+
+      forEachXYZComponent(
+        [&](XYZComponent c){
+          component(mesh_indices, c) =
+            result.next(mesh_state.scale_solve_flags.component(c));
+        }
+      );
+    }
+  }
+
+  return result;
+}
+
+
+// The jacobian rows for the residuals of one distance error.
+namespace {
+struct DenseJacobianRows {
+  Eigen::MatrixXf &jacobian;
+  Eigen::Index first_row;
+  Eigen::Index n_rows;
+
+  template <typename Derivatives>
+  void addToColumn(size_t column, const Derivatives &derivatives)
+  {
+    jacobian.block(first_row, column, n_rows, 1) += derivatives.head(n_rows);
+  }
+};
+}
+
+
+// Entries for the same row and column get summed when the sparse matrix
+// is made.
+namespace {
+struct SparseJacobianRows {
+  vector<Eigen::Triplet<float>> &entries;
+  Eigen::Index first_row;
+  Eigen::Index n_rows;
+
+  template <typename Derivatives>
+  void addToColumn(size_t column, const Derivatives &derivatives)
+  {
+    for (Eigen::Index i = 0; i != n_rows; ++i) {
+      entries.emplace_back(first_row + i, column, derivatives[i]);
+    }
+  }
+};
+}
+
+
+template <typename Rows, typename Derivatives>
+static void
+  addDerivatives(
+    Rows &rows,
+    const Optional<size_t> &maybe_index,
+    const Derivatives &derivatives
+  )
+{
+  if (maybe_index) {
+    rows.addToColumn(*maybe_index, derivatives);
+  }
+}
+
+
+template <typename Rows>
+static void
+  addXYZDerivatives(
+    Rows &rows,
+    const XYZVariableIndices &indices,
+    const Eigen::Matrix3f &derivatives
+  )
+{
+  addDerivatives(rows, indices.x, derivatives.col(0));
+  addDerivatives(rows, indices.y, derivatives.col(1));
+  addDerivatives(rows, indices.z, derivatives.col(2));
+}
+
+
+template <typename Rows>
+static void
+  addDerivativesToRows(
+    Rows &rows,
+    const ResidualDerivatives &derivatives,
+    const VariableIndices &variable_indices
+  )
+{
+  for (auto &body_derivatives : derivatives.bodies) {
+    const BodyVariableIndices &body_indices =
+      variable_indices.bodies[body_derivatives.body_index];
+
+    addXYZDerivatives(
+      rows, body_indices.translation, body_derivatives.translation
+    );
+
+    addXYZDerivatives(rows, body_indices.rotation, body_derivatives.rotation);
+    addDerivatives(rows, body_indices.scale, body_derivatives.scale);
+  }
+
+  for (auto &mesh_derivatives : derivatives.meshes) {
+    BodyMesh body_mesh = mesh_derivatives.body_mesh;
+
+    const XYZVariableIndices &mesh_indices =
+      variable_indices.bodies[body_mesh.body.index]
+      .mesh_scales[body_mesh.index];
+
+    addXYZDerivatives(rows, mesh_indices, mesh_derivatives.scale);
+  }
+}
+
+
+static Eigen::Index nResiduals(const SceneState &scene_state)
+{
+  Eigen::Index n_residuals = 0;
+
+  for (auto &distance_error : scene_state.distance_errors) {
+    n_residuals += distanceErrorResidualCount(distance_error);
+  }
+
+  return n_residuals;
+}
+
+
+// Calls f(distance_error, first_row, n_rows) for each distance error with
+// residuals.
+template <typename F>
+static void forEachResidualRange(const SceneState &scene_state, const F &f)
+{
+  Eigen::Index row_index = 0;
+
+  for (auto &distance_error : scene_state.distance_errors) {
+    int n_error_residuals = distanceErrorResidualCount(distance_error);
+
+    if (n_error_residuals != 0) {
+      f(distance_error, row_index, n_error_residuals);
+    }
+
+    row_index += n_error_residuals;
+  }
+}
+
+
+template <typename MakeRows>
+static void
+  evaluateResiduals(
+    const SceneState &scene_state,
+    GlobalTransformCache &cache,
+    const VariableIndices &variable_indices,
+    Eigen::VectorXf &residuals,
+    bool with_derivatives,
+    const MakeRows &make_rows
+  )
+{
+  ResidualDerivatives derivatives;
+
+  forEachResidualRange(
+    scene_state,
+    [&](
+      const SceneState::DistanceError &distance_error,
+      Eigen::Index first_row,
+      int n_rows
+    ){
+      Eigen::Vector3f error_residuals;
+
+      if (with_derivatives) {
+        derivatives.clear();
+
+        evaluateDistanceErrorResiduals(
+          distance_error, scene_state, cache, error_residuals, &derivatives
+        );
+
+        auto rows = make_rows(first_row, n_rows);
+        addDerivativesToRows(rows, derivatives, variable_indices);
+      }
+      else {
+        evaluateDistanceErrorResiduals(
+          distance_error, scene_state, cache, error_residuals
+        );
+      }
+
+      for (int i = 0; i != n_rows; ++i) {
+        residuals[first_row + i] = error_residuals[i];
+      }
+    }
+  );
+}
+
+
+static void
+  evaluateResiduals(
+    const SceneState &scene_state,
+    GlobalTransformCache &cache,
+    const VariableIndices &variable_indices,
+    Eigen::VectorXf &residuals,
+    Eigen::MatrixXf *jacobian_ptr
+  )
+{
+  Eigen::Index n_residuals = nResiduals(scene_state);
+  residuals.resize(n_residuals);
+
+  if (jacobian_ptr) {
+    jacobian_ptr->setZero(n_residuals, variable_indices.n_variables);
+  }
+
+  evaluateResiduals(
+    scene_state, cache, variable_indices, residuals,
+    jacobian_ptr != nullptr,
+    [&](Eigen::Index first_row, Eigen::Index n_rows){
+      return DenseJacobianRows{*jacobian_ptr, first_row, n_rows};
+    }
+  );
+}
+
+
+static void
+  evaluateResiduals(
+    const SceneState &scene_state,
+    GlobalTransformCache &cache,
+    const VariableIndices &variable_indices,
+    Eigen::VectorXf &residuals,
+    Eigen::SparseMatrix<float> *jacobian_ptr
+  )
+{
+  Eigen::Index n_residuals = nResiduals(scene_state);
+  residuals.resize(n_residuals);
+  vector<Eigen::Triplet<float>> entries;
+
+  evaluateResiduals(
+    scene_state, cache, variable_indices, residuals,
+    jacobian_ptr != nullptr,
+    [&](Eigen::Index first_row, Eigen::Index n_rows){
+      return SparseJacobianRows{entries, first_row, n_rows};
+    }
+  );
+
+  if (jacobian_ptr) {
+    jacobian_ptr->resize(n_residuals, variable_indices.n_variables);
+    jacobian_ptr->setFromTriplets(entries.begin(), entries.end());
+  }
+}
+
+
+static void
+  setOwner(
+    vector<SolveVariableOwner> &owners,
+    const Optional<size_t> &maybe_index,
+    const SolveVariableOwner &owner
+  )
+{
+  if (maybe_index) {
+    owners[*maybe_index] = owner;
+  }
+}
+
+
+static void
+  setXYZOwner(
+    vector<SolveVariableOwner> &owners,
+    const XYZVariableIndices &indices,
+    const SolveVariableOwner &owner
+  )
+{
+  setOwner(owners, indices.x, owner);
+  setOwner(owners, indices.y, owner);
+  setOwner(owners, indices.z, owner);
+}
+
+
+static vector<SolveVariableOwner>
+  variableOwners(const VariableIndices &variable_indices)
+{
+  vector<SolveVariableOwner> owners(variable_indices.n_variables);
+
+  for (BodyIndex body_index : indicesOf(variable_indices.bodies)) {
+    const BodyVariableIndices &body_indices =
+      variable_indices.bodies[body_index];
+
+    SolveVariableOwner body_owner{body_index, {}};
+    setXYZOwner(owners, body_indices.translation, body_owner);
+    setXYZOwner(owners, body_indices.rotation, body_owner);
+    setOwner(owners, body_indices.scale, body_owner);
+
+    for (MeshIndex mesh_index : indicesOf(body_indices.mesh_scales)) {
+      setXYZOwner(
+        owners,
+        body_indices.mesh_scales[mesh_index],
+        SolveVariableOwner{body_index, mesh_index}
+      );
+    }
+  }
+
+  return owners;
+}
+
+
+namespace {
+struct SceneValueRef {
+  float &value;
+  float inv_scale;
+};
+}
+
+
+static vector<SceneValueRef> solvedValueRefs(SceneState &scene_state)
+{
+  vector<SceneValueRef> refs;
 
   forEachSceneValue(
     scene_state,
-    [&](const float value, bool solve_flag, float scale)
-    {
-      getValue(variables, value, scale, solve_flag);
+    [&](float &value, bool solve_flag, float scale){
+      if (solve_flag) {
+        refs.push_back(SceneValueRef{value, 1/scale});
+      }
     }
   );
 
-  auto f = [&]{
-    updateState(scene_state, variables);
-    updateErrorsInState(scene_state);
-    return sceneError(scene_state);
-  };
+  return refs;
+}
+
+
+// Evaluates the scene error while the coordinate descent changes one
+// variable at a time, by only updating the distance errors that depend
+// on the changed variables, and only recomputing the global transforms and
+// points of the changed body and its descendants.  The total is
+// accumulated in double precision so that repeatedly adjusting it doesn't
+// drift.
+namespace {
+struct IncrementalSceneError {
+  const vector<float> &variables;
+  SolvePlan plan;
+  const SolveGraph graph;
+  Eigen::ArrayXf errors;
+  double total_error = 0;
+  Optional<size_t> maybe_previous_variable_index;
+
+  IncrementalSceneError(
+    const SceneState &scene_state,
+    const vector<float> &variables_arg,
+    const VariableIndices &variable_indices
+  )
+  : variables(variables_arg),
+    plan(makeSolvePlan(scene_state)),
+    graph(makeSolveGraph(variableOwners(variable_indices), scene_state)),
+    errors(Eigen::ArrayXf::Zero(scene_state.distance_errors.size()))
+  {
+    assert(plan.variable_value_indices.size() == variables.size());
+  }
+
+  float all()
+  {
+    updateTransforms();
+    return updateErrors();
+  }
+
+  // These are the two parts of all().
+
+  void updateTransforms()
+  {
+    setPlanVariables(plan, variables);
+    updatePlanPoints(plan);
+  }
+
+  float updateErrors()
+  {
+    evaluatePlanErrors(plan, errors);
+    total_error = errors.cast<double>().sum();
+    maybe_previous_variable_index.reset();
+    return total_error;
+  }
+
+  float changed(size_t variable_index)
+  {
+    if (maybe_previous_variable_index) {
+      if (*maybe_previous_variable_index != variable_index) {
+        updateVariable(*maybe_previous_variable_index);
+      }
+    }
+
+    updateVariable(variable_index);
+    maybe_previous_variable_index = variable_index;
+    return total_error;
+  }
+
+  private:
+    void updateVariable(size_t variable_index)
+    {
+      if (!setPlanVariable(plan, variable_index, variables[variable_index])) {
+        return;
+      }
+
+      updatePlanPointsForVariable(plan, variable_index);
+
+      const vector<DistanceErrorIndex> &error_indices =
+        graph.variable_errors[variable_index];
+
+      total_error -= sumOfErrors(error_indices);
+      evaluatePlanErrors(plan, error_indices, errors);
+      total_error += sumOfErrors(error_indices);
+    }
+
+    double sumOfErrors(const vector<DistanceErrorIndex> &error_indices) const
+    {
+      double sum = 0;
+
+      for (DistanceErrorIndex i : error_indices) {
+        sum += errors[i];
+      }
+
+      return sum;
+    }
+};
+}
+
+
+namespace {
+struct SceneErrorFunction : FunctionInterface {
+  IncrementalSceneError &error;
+  SolveStats &stats;
+  const SolveLimits &limits;
+
+  SceneErrorFunction(
+    IncrementalSceneError &error_arg,
+    SolveStats &stats_arg,
+    const SolveLimits &limits_arg
+  )
+  : error(error_arg),
+    stats(stats_arg),
+    limits(limits_arg)
+  {
+  }
+
+  float operator()() const override
+  {
+    ++stats.n_evaluations;
+    Clock::time_point start_time = Clock::now();
+    error.updateTransforms();
+    stats.transform_seconds += secondsSince(start_time);
+    start_time = Clock::now();
+    float result = error.updateErrors();
+    stats.error_seconds += secondsSince(start_time);
+
+    if (stats.error_history.empty()) {
+      stats.error_history.push_back(result);
+    }
+
+    return result;
+  }
+
+  float operator()(size_t variable_index) const override
+  {
+    ++stats.n_evaluations;
+    Clock::time_point start_time = Clock::now();
+    float result = error.changed(variable_index);
+    stats.error_seconds += secondsSince(start_time);
+    return result;
+  }
+
+  void iterationFinished(float total_error) const override
+  {
+    ++stats.n_iterations;
+    stats.error_history.push_back(total_error);
+  }
+
+  bool shouldStop() const override
+  {
+    return limits.reached(stats);
+  }
+};
+}
+
+
+static void
+  minimizeWithCoordinateDescent(
+    SceneState &scene_state,
+    vector<float> &variables,
+    const SolveLimits &limits,
+    SolveStats &stats
+  )
+{
+  VariableIndices variable_indices = variableIndices(scene_state);
+  assert(variable_indices.n_variables == variables.size());
+  IncrementalSceneError error(scene_state, variables, variable_indices);
+  SceneErrorFunction f(error, stats, limits);
+  minimizeImpl(f, variables);
+}
+
+
+// The step is about the cube root of the float epsilon, which balances the
+// truncation error of a central difference against the rounding error.
+static const float finite_difference_step = 5e-3;
+
+
+static void
+  evaluatePlanResidualsWithVariable(
+    SolvePlan &plan,
+    size_t variable_index,
+    float value,
+    Eigen::VectorXf &residuals
+  )
+{
+  setPlanVariable(plan, variable_index, value);
+  updatePlanPointsForVariable(plan, variable_index);
+  evaluatePlanResiduals(plan, residuals);
+}
+
+
+// Finds the jacobian of the plan residuals from central differences.  Each
+// column is found by moving one variable both ways in a copy of the plan,
+// so the columns are independent, and if there is a thread pool, its
+// threads find them concurrently, each using its own copy.  The copies are
+// brought up to date the first time a thread is used for a jacobian.
+namespace {
+struct FiniteDifferenceJacobian {
+  ThreadPool *thread_pool_ptr;
+  vector<SolvePlan> thread_plans;
+  vector<size_t> thread_generations;
+  vector<Eigen::VectorXf> thread_forward_residuals;
+  vector<Eigen::VectorXf> thread_reverse_residuals;
+  size_t generation = 0;
+
+  explicit FiniteDifferenceJacobian(ThreadPool *thread_pool_ptr_arg)
+  : thread_pool_ptr(thread_pool_ptr_arg)
+  {
+    size_t n_threads = thread_pool_ptr ? thread_pool_ptr->nThreads() : 1;
+    thread_plans.resize(n_threads);
+    thread_generations.assign(n_threads, 0);
+    thread_forward_residuals.resize(n_threads);
+    thread_reverse_residuals.resize(n_threads);
+  }
+
+  // The plan must be up to date with the variables.
+  void
+    evaluate(
+      const SolvePlan &plan,
+      const vector<float> &variables,
+      Eigen::Index n_residuals,
+      Eigen::MatrixXf &jacobian
+    )
+  {
+    ++generation;
+    size_t n_variables = variables.size();
+    jacobian.resize(n_residuals, n_variables);
+
+    auto evaluate_column = [&](size_t variable_index, size_t thread_index){
+      evaluateColumn(plan, variables, variable_index, thread_index, jacobian);
+    };
+
+    if (thread_pool_ptr) {
+      thread_pool_ptr->forEachIndex(n_variables, evaluate_column);
+    }
+    else {
+      for (size_t i = 0; i != n_variables; ++i) {
+        evaluate_column(i, /*thread_index*/0);
+      }
+    }
+  }
+
+  private:
+    void
+      evaluateColumn(
+        const SolvePlan &plan,
+        const vector<float> &variables,
+        size_t variable_index,
+        size_t thread_index,
+        Eigen::MatrixXf &jacobian
+      )
+    {
+      SolvePlan &thread_plan = thread_plans[thread_index];
+
+      if (thread_generations[thread_index] != generation) {
+        thread_plan = plan;
+        thread_generations[thread_index] = generation;
+      }
+
+      Eigen::VectorXf &forward_residuals =
+        thread_forward_residuals[thread_index];
+
+      Eigen::VectorXf &reverse_residuals =
+        thread_reverse_residuals[thread_index];
+
+      float value = variables[variable_index];
+      float step = finite_difference_step*std::max(1.0f, std::abs(value));
+      float forward_value = value + step;
+      float reverse_value = value - step;
+
+      evaluatePlanResidualsWithVariable(
+        thread_plan, variable_index, forward_value, forward_residuals
+      );
+
+      evaluatePlanResidualsWithVariable(
+        thread_plan, variable_index, reverse_value, reverse_residuals
+      );
+
+      setPlanVariable(thread_plan, variable_index, value);
+      updatePlanPointsForVariable(thread_plan, variable_index);
+
+      jacobian.col(variable_index) =
+        (forward_residuals - reverse_residuals)/(forward_value - reverse_value);
+    }
+};
+}
+
+
+namespace {
+struct SceneResiduals : LeastSquaresInterface, SparseLeastSquaresInterface {
+  SceneState &scene_state;
+  const vector<float> &variables;
+  const VariableIndices variable_indices;
+  mutable SolvePlan plan;
+  const bool is_serial_chain;
+  const bool use_finite_differences;
+  mutable FiniteDifferenceJacobian finite_difference_jacobian;
+  const vector<SolveVariableOwner> variable_owners;
+  mutable GlobalTransformCache cache;
+
+  // The variables that the cache was last brought up to date with.
+  mutable vector<float> cache_variables;
+
+  SolveStats &stats;
+  const SolveLimits &limits;
+
+  SceneResiduals(
+    SceneState &scene_state_arg,
+    const vector<float> &variables_arg,
+    const SolveOptions &options,
+    SolveStats &stats_arg,
+    const SolveLimits &limits_arg
+  )
+  : scene_state(scene_state_arg),
+    variables(variables_arg),
+    variable_indices(variableIndices(scene_state_arg)),
+    plan(makeSolvePlan(scene_state_arg)),
+    is_serial_chain(isSerialRotationChain(plan)),
+    use_finite_differences(options.finite_difference_jacobian),
+    finite_difference_jacobian(options.thread_pool_ptr),
+    variable_owners(variableOwners(variable_indices)),
+    cache(scene_state_arg),
+    cache_variables(variables_arg),
+    stats(stats_arg),
+    limits(limits_arg)
+  {
+    assert(variable_indices.n_variables == variables.size());
+  }
+
+  // The plan is enough when the jacobian isn't needed.
+  void evaluateWithPlan(Eigen::VectorXf &residuals) const
+  {
+    Clock::time_point start_time = Clock::now();
+    setPlanVariables(plan, variables);
+    updatePlanPoints(plan);
+    stats.transform_seconds += secondsSince(start_time);
+    start_time = Clock::now();
+    evaluatePlanResiduals(plan, residuals);
+    stats.error_seconds += secondsSince(start_time);
+  }
+
+  // Only the bodies whose variables changed since the last evaluation, and
+  // their descendants, need their global transforms recomputed.
+  void updateCache() const
+  {
+    for (size_t i = 0; i != variables.size(); ++i) {
+      if (variables[i] != cache_variables[i]) {
+        const SolveVariableOwner &owner = variable_owners[i];
+
+        if (!owner.maybe_mesh_index) {
+          cache.invalidateBody(owner.body_index);
+        }
+
+        cache_variables[i] = variables[i];
+      }
+    }
+
+    cache.computeAll();
+  }
+
+  template <typename Jacobian>
+  void
+    evaluateWithScene(Eigen::VectorXf &residuals, Jacobian *jacobian_ptr) const
+  {
+    Clock::time_point start_time = Clock::now();
+    updateState(scene_state, variables);
+    updateCache();
+    stats.transform_seconds += secondsSince(start_time);
+    start_time = Clock::now();
+
+    evaluateResiduals(
+      scene_state, cache, variable_indices, residuals, jacobian_ptr
+    );
+
+    stats.error_seconds += secondsSince(start_time);
+  }
+
+  // The plan can only give the jacobian for rotations, which is all that
+  // a serial chain has.
+  void evaluatePlanJacobian(Eigen::MatrixXf &jacobian) const
+  {
+    Clock::time_point start_time = Clock::now();
+    evaluatePlanRotationJacobian(plan, jacobian);
+    stats.error_seconds += secondsSince(start_time);
+  }
+
+  void evaluatePlanJacobian(Eigen::SparseMatrix<float> &jacobian) const
+  {
+    Eigen::MatrixXf dense_jacobian;
+    evaluatePlanJacobian(dense_jacobian);
+    jacobian = dense_jacobian.sparseView();
+  }
+
+  // Each column takes two evaluations of the residuals.  The plan must be
+  // up to date.
+  void
+    evaluateFiniteDifferenceJacobian(
+      Eigen::Index n_residuals,
+      Eigen::MatrixXf &jacobian
+    ) const
+  {
+    Clock::time_point start_time = Clock::now();
+
+    finite_difference_jacobian.evaluate(
+      plan, variables, n_residuals, jacobian
+    );
+
+    stats.error_seconds += secondsSince(start_time);
+    stats.n_evaluations += 2*variables.size();
+  }
+
+  void
+    evaluateFiniteDifferenceJacobian(
+      Eigen::Index n_residuals,
+      Eigen::SparseMatrix<float> &jacobian
+    ) const
+  {
+    Eigen::MatrixXf dense_jacobian;
+    evaluateFiniteDifferenceJacobian(n_residuals, dense_jacobian);
+    jacobian = dense_jacobian.sparseView();
+  }
+
+  template <typename Jacobian>
+  void evaluate(Eigen::VectorXf &residuals, Jacobian *jacobian_ptr) const
+  {
+    ++stats.n_evaluations;
+
+    if (jacobian_ptr && use_finite_differences) {
+      evaluateWithPlan(residuals);
+      evaluateFiniteDifferenceJacobian(residuals.size(), *jacobian_ptr);
+    }
+    else if (jacobian_ptr && !is_serial_chain) {
+      evaluateWithScene(residuals, jacobian_ptr);
+    }
+    else {
+      evaluateWithPlan(residuals);
+
+      if (jacobian_ptr) {
+        evaluatePlanJacobian(*jacobian_ptr);
+      }
+    }
+
+    if (stats.error_history.empty()) {
+      stats.error_history.push_back(residuals.squaredNorm());
+    }
+  }
+
+  void
+    operator()(
+      Eigen::VectorXf &residuals,
+      Eigen::MatrixXf *jacobian_ptr
+    ) const override
+  {
+    evaluate(residuals, jacobian_ptr);
+  }
+
+  void
+    operator()(
+      Eigen::VectorXf &residuals,
+      Eigen::SparseMatrix<float> *jacobian_ptr
+    ) const override
+  {
+    evaluate(residuals, jacobian_ptr);
+  }
+
+  void iterationFinished(float total_error) const override
+  {
+    ++stats.n_iterations;
+    stats.error_history.push_back(total_error);
+  }
+
+  bool shouldStop() const override
+  {
+    return limits.reached(stats);
+  }
+};
+}
+
+
+// Serial chains, like an arm reaching for a target, usually have far
+// fewer residuals than variables, so their steps are found from equations
+// the size of the residuals instead of the variables.
+static void
+  minimizeWithLevenbergMarquardt(
+    SceneState &scene_state,
+    vector<float> &variables,
+    const SolveOptions &options,
+    const SolveLimits &limits,
+    SolveStats &stats
+  )
+{
+  SceneResiduals f(scene_state, variables, options, stats, limits);
+  const LeastSquaresInterface &dense_f = f;
+  const SparseLeastSquaresInterface &sparse_f = f;
+
+  bool is_sparse_method =
+    (options.method == SolveMethod::sparse_levenberg_marquardt);
+
+  if (!is_sparse_method && f.is_serial_chain) {
+    if (size_t(nResiduals(scene_state)) < variables.size()) {
+      minimizeUnderdeterminedLeastSquaresImpl(dense_f, variables);
+    }
+    else {
+      minimizeLeastSquaresImpl(dense_f, variables);
+    }
+  }
+  else if (is_sparse_method || variables.size() >= min_sparse_variables) {
+    minimizeLeastSquaresImpl(sparse_f, variables);
+  }
+  else {
+    minimizeLeastSquaresImpl(dense_f, variables);
+  }
+}
+
+
+static void
+  solveAllVariables(
+    SceneState &scene_state,
+    const SolveOptions &options,
+    const SolveLimits &limits,
+    SolveStats &stats
+  )
+{
+  vector<float> variables;
+
+  forEachSceneValue(
+    scene_state,
+    [&](const float value, bool solve_flag, float scale)
+    {
+      getValue(variables, value, scale, solve_flag);
+    }
+  );
+
+  stats.n_variables = variables.size();
+
+  switch (options.method) {
+    case SolveMethod::coordinate_descent:
+      minimizeWithCoordinateDescent(
+        scene_state, variables, limits, stats
+      );
+      break;
+    case SolveMethod::levenberg_marquardt:
+    case SolveMethod::sparse_levenberg_marquardt:
+      minimizeWithLevenbergMarquardt(
+        scene_state, variables, options, limits, stats
+      );
+      break;
+  }
+
+  updateState(scene_state, variables);
+  updateErrorsInState(scene_state);
+}
+
+
+// Calls f(solve_flag, variable_index) for each solve flag that was set when
+// the variable indices were made.
+template <typename F>
+static void
+  forEachVariableSolveFlag(
+    SceneState &scene_state,
+    const VariableIndices &variable_indices,
+    const F &f
+  )
+{
+  auto visit = [&](bool &solve_flag, const Optional<size_t> &maybe_index){
+    if (maybe_index) {
+      f(solve_flag, *maybe_index);
+    }
+  };
+
+  for (auto body_index : indicesOf(scene_state.bodies())) {
+    SceneState::Body &body_state = scene_state.body(body_index);
+    SceneState::TransformSolveFlags &solve_flags = body_state.solve_flags;
+
+    const BodyVariableIndices &body_indices =
+      variable_indices.bodies[body_index];
+
+    forEachXYZComponent([&](XYZComponent c){
+      visit(
+        component(solve_flags.translation, c),
+        component(body_indices.translation, c)
+      );
+
+      visit(
+        component(solve_flags.rotation, c),
+        component(body_indices.rotation, c)
+      );
+    });
+
+    visit(solve_flags.scale, body_indices.scale);
+
+    for (auto mesh_index : indicesOf(body_state.meshes)) {
+      forEachXYZComponent([&](XYZComponent c){
+        visit(
+          component(body_state.meshes[mesh_index].scale_solve_flags, c),
+          component(body_indices.mesh_scales[mesh_index], c)
+        );
+      });
+    }
+  }
+}
+
+
+static void
+  keepOnlySolveFlags(
+    SceneState &scene_state,
+    const VariableIndices &variable_indices,
+    const vector<bool> &keep
+  )
+{
+  forEachVariableSolveFlag(
+    scene_state,
+    variable_indices,
+    [&](bool &solve_flag, size_t variable_index){
+      if (!keep[variable_index]) {
+        solve_flag = false;
+      }
+    }
+  );
+}
+
+
+// A copy of the scene where only the variables and distance errors of the
+// component are solved.
+static SceneState
+  componentSceneState(
+    const SceneState &scene_state,
+    const VariableIndices &variable_indices,
+    const SolveComponent &component
+  )
+{
+  SceneState result = scene_state;
+  vector<bool> keep(variable_indices.n_variables, false);
+
+  for (size_t variable_index : component.variable_indices) {
+    keep[variable_index] = true;
+  }
+
+  keepOnlySolveFlags(result, variable_indices, keep);
+  result.distance_errors.clear();
+
+  for (DistanceErrorIndex error_index : component.distance_error_indices) {
+    result.distance_errors.push_back(scene_state.distance_errors[error_index]);
+  }
+
+  return result;
+}
+
+
+// The history of the total error is the sum of the component histories,
+// where a component that finished early keeps its last error, plus the
+// errors that don't depend on any variables.
+static void
+  addComponentStats(
+    SolveStats &stats,
+    const vector<SolveStats> &component_stats,
+    float total_error
+  )
+{
+  size_t n_history = 0;
+  double final_components_error = 0;
+
+  for (const SolveStats &component : component_stats) {
+    stats.n_evaluations += component.n_evaluations;
+    stats.n_iterations = std::max(stats.n_iterations, component.n_iterations);
+    stats.transform_seconds += component.transform_seconds;
+    stats.error_seconds += component.error_seconds;
+    stats.ran_out_of_budget |= component.ran_out_of_budget;
+    n_history = std::max(n_history, component.error_history.size());
+
+    if (!component.error_history.empty()) {
+      final_components_error += component.error_history.back();
+    }
+  }
+
+  vector<double> history(n_history, total_error - final_components_error);
+
+  for (const SolveStats &component : component_stats) {
+    const vector<float> &component_history = component.error_history;
+
+    for (size_t i = 0; i != component_history.size(); ++i) {
+      history[i] += component_history[i];
+    }
+
+    if (!component_history.empty()) {
+      for (size_t i = component_history.size(); i != n_history; ++i) {
+        history[i] += component_history.back();
+      }
+    }
+  }
+
+  stats.error_history.assign(history.begin(), history.end());
+}
+
+
+// Copies the values that were solved in the component's copy of the scene.
+static void
+  copyComponentValues(
+    const SolveComponent &component,
+    SceneState &component_state,
+    const vector<SceneValueRef> &value_refs
+  )
+{
+  const vector<size_t> &component_variable_indices =
+    component.variable_indices;
+
+  vector<SceneValueRef> component_value_refs =
+    solvedValueRefs(component_state);
+
+  assert(component_value_refs.size() == component_variable_indices.size());
+
+  for (size_t j = 0; j != component_variable_indices.size(); ++j) {
+    value_refs[component_variable_indices[j]].value =
+      component_value_refs[j].value;
+  }
+}
+
+
+// A copy of the scene for solving components on one thread.  Its solve
+// flags and distance errors are only set while a component is being
+// solved, and the other values don't need to be restored afterwards, since
+// they don't affect the errors of the other components.
+namespace {
+struct ComponentScratch {
+  SceneState scene_state;
+
+  // These are indexed by the variable indices of the original scene.
+  vector<bool *> solve_flag_ptrs;
+  vector<SceneValueRef> value_refs;
+};
+}
+
+
+static std::unique_ptr<ComponentScratch>
+  makeComponentScratch(
+    const SceneState &scene_state,
+    const VariableIndices &variable_indices
+  )
+{
+  auto scratch_ptr = std::make_unique<ComponentScratch>();
+  SceneState &scratch_state = scratch_ptr->scene_state;
+  scratch_state = scene_state;
+  scratch_state.distance_errors.clear();
+  scratch_ptr->value_refs = solvedValueRefs(scratch_state);
+
+  vector<bool *> &solve_flag_ptrs = scratch_ptr->solve_flag_ptrs;
+  solve_flag_ptrs.resize(variable_indices.n_variables);
+
+  forEachVariableSolveFlag(
+    scratch_state,
+    variable_indices,
+    [&](bool &solve_flag, size_t variable_index){
+      solve_flag = false;
+      solve_flag_ptrs[variable_index] = &solve_flag;
+    }
+  );
+
+  return scratch_ptr;
+}
+
+
+static void
+  setComponentSolveFlags(
+    ComponentScratch &scratch,
+    const SolveComponent &component,
+    bool value
+  )
+{
+  for (size_t variable_index : component.variable_indices) {
+    *scratch.solve_flag_ptrs[variable_index] = value;
+  }
+}
+
+
+// Solves the component in the scratch scene, and sets the solved values in
+// the order of the component's variables.
+static void
+  solveComponent(
+    ComponentScratch &scratch,
+    const SceneState &scene_state,
+    const SolveComponent &component,
+    const SolveOptions &options,
+    const SolveLimits &limits,
+    SolveStats &stats,
+    vector<float> &values
+  )
+{
+  SceneState &component_state = scratch.scene_state;
+
+  for (DistanceErrorIndex error_index : component.distance_error_indices) {
+    component_state.distance_errors.push_back(
+      scene_state.distance_errors[error_index]
+    );
+  }
+
+  setComponentSolveFlags(scratch, component, true);
+  solveAllVariables(component_state, options, limits, stats);
+
+  for (size_t variable_index : component.variable_indices) {
+    values.push_back(scratch.value_refs[variable_index].value);
+  }
+
+  setComponentSolveFlags(scratch, component, false);
+  component_state.distance_errors.clear();
+}
+
+
+// The components are solved in a scratch copy of the scene for each thread
+// that is used, so they can be solved concurrently.  A thread pool that is
+// busy solving components runs any nested work, like the columns of a
+// finite difference jacobian, serially.
+static void
+  solveComponentsSeparately(
+    SceneState &scene_state,
+    const VariableIndices &variable_indices,
+    const vector<SolveComponent> &components,
+    const SolveOptions &options,
+    const SolveLimits &limits,
+    SolveStats &stats
+  )
+{
+  size_t n_components = components.size();
+  bool use_thread_pool = options.thread_pool_ptr && n_components > 1;
+  size_t n_threads = use_thread_pool ? options.thread_pool_ptr->nThreads() : 1;
+  vector<std::unique_ptr<ComponentScratch>> scratch_ptrs(n_threads);
+  vector<vector<float>> component_values(n_components);
+  vector<SolveStats> component_stats(n_components);
+
+  auto solve_component = [&](size_t component_index, size_t thread_index){
+    std::unique_ptr<ComponentScratch> &scratch_ptr =
+      scratch_ptrs[thread_index];
+
+    if (!scratch_ptr) {
+      scratch_ptr = makeComponentScratch(scene_state, variable_indices);
+    }
+
+    solveComponent(
+      *scratch_ptr,
+      scene_state,
+      components[component_index],
+      options,
+      limits,
+      component_stats[component_index],
+      component_values[component_index]
+    );
+  };
+
+  if (use_thread_pool) {
+    options.thread_pool_ptr->forEachIndex(n_components, solve_component);
+  }
+  else {
+    // A single component can use the thread pool for its finite difference
+    // jacobian.
+    for (size_t i = 0; i != n_components; ++i) {
+      solve_component(i, /*thread_index*/0);
+    }
+  }
+
+  vector<SceneValueRef> value_refs = solvedValueRefs(scene_state);
+
+  for (size_t i = 0; i != n_components; ++i) {
+    const vector<size_t> &component_variable_indices =
+      components[i].variable_indices;
+
+    for (size_t j = 0; j != component_variable_indices.size(); ++j) {
+      value_refs[component_variable_indices[j]].value =
+        component_values[i][j];
+    }
+  }
+
+  updateErrorsInState(scene_state);
+  addComponentStats(stats, component_stats, scene_state.total_error);
+}
+
+
+static size_t nComponentVariables(const vector<SolveComponent> &components)
+{
+  size_t result = 0;
+
+  for (const SolveComponent &component : components) {
+    result += component.variable_indices.size();
+  }
+
+  return result;
+}
+
+
+static SolveComponent mergedComponent(const vector<SolveComponent> &components)
+{
+  SolveComponent result;
+
+  for (const SolveComponent &component : components) {
+    result.variable_indices.insert(
+      result.variable_indices.end(),
+      component.variable_indices.begin(),
+      component.variable_indices.end()
+    );
+
+    result.distance_error_indices.insert(
+      result.distance_error_indices.end(),
+      component.distance_error_indices.begin(),
+      component.distance_error_indices.end()
+    );
+  }
+
+  std::sort(result.variable_indices.begin(), result.variable_indices.end());
+
+  std::sort(
+    result.distance_error_indices.begin(),
+    result.distance_error_indices.end()
+  );
+
+  return result;
+}
+
+
+// Variables that don't affect any distance error are pruned, so that no
+// evaluations are spent on them.
+static void
+  solveSceneParts(
+    SceneState &scene_state,
+    const VariableIndices &variable_indices,
+    const SolveOptions &options,
+    const SolveLimits &limits,
+    SolveStats &stats
+  )
+{
+  vector<SolveComponent> components =
+    solveComponents(
+      makeSolveGraph(variableOwners(variable_indices), scene_state),
+      scene_state.distance_errors.size()
+    );
+
+  stats.n_pruned_variables =
+    variable_indices.n_variables - nComponentVariables(components);
+
+  if (components.empty()) {
+    updateErrorsInState(scene_state);
+    stats.error_history.push_back(scene_state.total_error);
+    return;
+  }
+
+  if (!options.split_into_components && components.size() > 1) {
+    components = {mergedComponent(components)};
+  }
+
+  if (components.size() > 1 || stats.n_pruned_variables != 0) {
+    solveComponentsSeparately(
+      scene_state, variable_indices, components, options, limits, stats
+    );
+  }
+  else {
+    solveAllVariables(scene_state, options, limits, stats);
+  }
+}
+
+
+static bool
+  haveCommonTag(
+    const SceneState::SolveTags &tags1,
+    const SceneState::SolveTags &tags2
+  )
+{
+  for (auto &tag : tags1) {
+    if (std::find(tags2.begin(), tags2.end(), tag) != tags2.end()) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+// The variables of the bodies, and the distance errors, that are tagged
+// with any of the stage's tags.  Mesh scales use the tags of their body.
+static SolveComponent
+  stageComponent(
+    const SceneState &scene_state,
+    const vector<SolveVariableOwner> &variable_owners,
+    const SceneState::SolveStage &stage
+  )
+{
+  SolveComponent result;
+
+  for (auto variable_index : indicesOf(variable_owners)) {
+    const SceneState::Body &body_state =
+      scene_state.body(variable_owners[variable_index].body_index);
+
+    if (haveCommonTag(body_state.solve_flags.tags, stage.tags)) {
+      result.variable_indices.push_back(variable_index);
+    }
+  }
+
+  for (auto error_index : indicesOf(scene_state.distance_errors)) {
+    const SceneState::DistanceError &distance_error =
+      scene_state.distance_errors[error_index];
+
+    if (haveCommonTag(distance_error.tags, stage.tags)) {
+      result.distance_error_indices.push_back(error_index);
+    }
+  }
+
+  return result;
+}
+
+
+static void addStageStats(SolveStats &stats, const SolveStats &stage_stats)
+{
+  stats.n_evaluations += stage_stats.n_evaluations;
+  stats.n_iterations += stage_stats.n_iterations;
+  stats.transform_seconds += stage_stats.transform_seconds;
+  stats.error_seconds += stage_stats.error_seconds;
+  stats.ran_out_of_budget |= stage_stats.ran_out_of_budget;
+}
+
+
+// Each stage solves a copy of the scene with only the stage's variables
+// and distance errors, so the parts of a stage that are independent of
+// each other are solved separately, and concurrently if there is a thread
+// pool.  The error history has the total error of the whole scene after
+// each stage.
+static void
+  solveStages(
+    SceneState &scene_state,
+    const VariableIndices &variable_indices,
+    const SolveOptions &options,
+    const SolveLimits &limits,
+    SolveStats &stats
+  )
+{
+  vector<SolveVariableOwner> variable_owners =
+    variableOwners(variable_indices);
+
+  updateErrorsInState(scene_state);
+  stats.error_history.push_back(scene_state.total_error);
+
+  for (const SceneState::SolveStage &stage : scene_state.solve_stages) {
+    if (limits.reached(stats)) {
+      return;
+    }
+
+    SolveComponent component =
+      stageComponent(scene_state, variable_owners, stage);
+
+    if (
+      component.variable_indices.empty() ||
+      component.distance_error_indices.empty()
+    ) {
+      continue;
+    }
+
+    SceneState stage_state =
+      componentSceneState(scene_state, variable_indices, component);
+
+    SolveStats stage_stats;
+
+    solveSceneParts(
+      stage_state,
+      variableIndices(stage_state),
+      options,
+      limits.afterEvaluations(stats.n_evaluations),
+      stage_stats
+    );
+
+    vector<SceneValueRef> value_refs = solvedValueRefs(scene_state);
+    copyComponentValues(component, stage_state, value_refs);
+    updateErrorsInState(scene_state);
+    addStageStats(stats, stage_stats);
+    stats.error_history.push_back(scene_state.total_error);
+  }
+}
+
+
+static bool hasAnySolveFlag(const SceneState::TransformSolveFlags &flags)
+{
+  bool result = flags.scale;
+
+  forEachXYZComponent([&](XYZComponent c){
+    result |= component(flags.translation, c);
+    result |= component(flags.rotation, c);
+  });
+
+  return result;
+}
+
+
+static bool hasAllRigidSolveFlags(const SceneState::TransformSolveFlags &flags)
+{
+  bool result = true;
+
+  forEachXYZComponent([&](XYZComponent c){
+    result &= component(flags.translation, c);
+    result &= component(flags.rotation, c);
+  });
+
+  return result;
+}
+
+
+// Whether the global position of a point on the body would be changed by
+// solving.
+static bool
+  isMovedBySolving(
+    Optional<BodyIndex> maybe_body_index,
+    const SceneState &scene_state
+  )
+{
+  while (maybe_body_index) {
+    const SceneState::Body &body_state = scene_state.body(*maybe_body_index);
+
+    if (hasAnySolveFlag(body_state.solve_flags)) {
+      return true;
+    }
+
+    maybe_body_index = body_state.maybe_parent_index;
+  }
+
+  return false;
+}
+
+
+static int bodyDepth(BodyIndex body_index, const SceneState &scene_state)
+{
+  int depth = 0;
+
+  Optional<BodyIndex> maybe_index =
+    scene_state.body(body_index).maybe_parent_index;
+
+  while (maybe_index) {
+    ++depth;
+    maybe_index = scene_state.body(*maybe_index).maybe_parent_index;
+  }
+
+  return depth;
+}
+
+
+// A marker on a body, scaled by the body's scale, and where a distance
+// error wants it to be, in the coordinates of the body's parent.
+namespace {
+struct AlignmentPair {
+  Eigen::Vector3f local;
+  Eigen::Vector3f target;
+  float weight;
+};
+}
+
+
+static void
+  addAlignmentPair(
+    const Optional<PointLink> &maybe_body_point,
+    const Optional<PointLink> &maybe_fixed_point,
+    float weight,
+    BodyIndex body_index,
+    const SceneState &scene_state,
+    const Transform &parent_inverse,
+    vector<AlignmentPair> &pairs
+  )
+{
+  if (!maybe_body_point || !maybe_body_point->maybe_marker) return;
+  if (!maybe_fixed_point || !maybe_fixed_point->maybe_marker) return;
+  MarkerIndex body_marker_index = maybe_body_point->maybe_marker->index;
+  MarkerIndex fixed_marker_index = maybe_fixed_point->maybe_marker->index;
+
+  const SceneState::Marker &body_marker =
+    scene_state.marker(body_marker_index);
+
+  const SceneState::Marker &fixed_marker =
+    scene_state.marker(fixed_marker_index);
+
+  if (body_marker.maybe_body_index != body_index) return;
+  if (isMovedBySolving(fixed_marker.maybe_body_index, scene_state)) return;
+  float scale = scene_state.body(body_index).transform.scale;
+
+  pairs.push_back(AlignmentPair{
+    makePointFromPositionState(body_marker.position)*scale,
+    parent_inverse*markerPredicted(scene_state, fixed_marker_index),
+    weight
+  });
+}
+
+
+static vector<AlignmentPair>
+  alignmentPairs(BodyIndex body_index, const SceneState &scene_state)
+{
+  vector<AlignmentPair> pairs;
+  Optional<BodyIndex> maybe_parent_index =
+    scene_state.body(body_index).maybe_parent_index;
+
+  Transform parent_inverse = Transform::Identity();
+
+  if (maybe_parent_index) {
+    GlobalTransformCache cache(scene_state);
+
+    parent_inverse =
+      cache.scaledGlobalTransform(*maybe_parent_index).inverse();
+  }
+
+  for (const SceneState::DistanceError &distance_error
+    : scene_state.distance_errors
+  ) {
+    if (distance_error.desired_distance != 0) continue;
+    if (distance_error.weight <= 0) continue;
+    const Optional<PointLink> &maybe_start = distance_error.optional_start;
+    const Optional<PointLink> &maybe_end = distance_error.optional_end;
+    float weight = distance_error.weight;
+
+    addAlignmentPair(
+      maybe_start, maybe_end, weight, body_index, scene_state,
+      parent_inverse, pairs
+    );
+
+    addAlignmentPair(
+      maybe_end, maybe_start, weight, body_index, scene_state,
+      parent_inverse, pairs
+    );
+  }
+
+  return pairs;
+}
+
+
+// The rotation and translation that best move the local points onto the
+// targets in the least-squares sense (the Kabsch algorithm).
+static Transform rigidAlignment(const vector<AlignmentPair> &pairs)
+{
+  float total_weight = 0;
+  Eigen::Vector3f local_center = Eigen::Vector3f::Zero();
+  Eigen::Vector3f target_center = Eigen::Vector3f::Zero();
+
+  for (const AlignmentPair &pair : pairs) {
+    total_weight += pair.weight;
+    local_center += pair.weight*pair.local;
+    target_center += pair.weight*pair.target;
+  }
+
+  local_center /= total_weight;
+  target_center /= total_weight;
+  Eigen::Matrix3f covariance = Eigen::Matrix3f::Zero();
+
+  for (const AlignmentPair &pair : pairs) {
+    covariance +=
+      pair.weight*
+      (pair.local - local_center)*(pair.target - target_center).transpose();
+  }
+
+  Eigen::JacobiSVD<Eigen::Matrix3f>
+    svd(covariance, Eigen::ComputeFullU | Eigen::ComputeFullV);
+
+  Eigen::Matrix3f u = svd.matrixU();
+  Eigen::Matrix3f v = svd.matrixV();
+  Eigen::Vector3f signs(1, 1, (v*u.transpose()).determinant() < 0 ? -1 : 1);
+  Eigen::Matrix3f rotation = v*signs.asDiagonal()*u.transpose();
+  Transform result = Transform::Identity();
+  result.linear() = rotation;
+  result.translation() = target_center - rotation*local_center;
+  return result;
+}
+
+
+// Moves each body whose translation and rotation are all solved to the
+// best rigid fit of its markers to the fixed markers that they have
+// distance errors with, if that reduces the total error.  Parents are
+// aligned before their children, so the children use the aligned parents.
+static void alignRigidBodies(SceneState &scene_state, SolveStats &stats)
+{
+  vector<BodyIndex> body_indices;
+
+  for (auto body_index : indicesOf(scene_state.bodies())) {
+    if (hasAllRigidSolveFlags(scene_state.body(body_index).solve_flags)) {
+      body_indices.push_back(body_index);
+    }
+  }
+
+  std::stable_sort(
+    body_indices.begin(), body_indices.end(),
+    [&](BodyIndex a, BodyIndex b){
+      return bodyDepth(a, scene_state) < bodyDepth(b, scene_state);
+    }
+  );
+
+  updateErrorsInState(scene_state);
+  ++stats.n_evaluations;
+
+  for (BodyIndex body_index : body_indices) {
+    vector<AlignmentPair> pairs = alignmentPairs(body_index, scene_state);
+
+    if (pairs.size() < 3) {
+      continue;
+    }
+
+    SceneState::Transform &transform_state =
+      scene_state.body(body_index).transform;
+
+    SceneState::Transform old_transform_state = transform_state;
+    float old_error = scene_state.total_error;
+
+    transform_state =
+      transformState(rigidAlignment(pairs), old_transform_state.scale);
+
+    updateErrorsInState(scene_state);
+    ++stats.n_evaluations;
+
+    if (!(scene_state.total_error < old_error)) {
+      transform_state = old_transform_state;
+      updateErrorsInState(scene_state);
+    }
+  }
+}
+
+
+SolveStats solveScene(SceneState &scene_state, const SolveOptions &options)
+{
+  Clock::time_point start_time = Clock::now();
+  SolveLimits limits(options, start_time);
+  SolveStats stats;
+  VariableIndices variable_indices = variableIndices(scene_state);
+
+  if (options.align_rigid_bodies_first) {
+    alignRigidBodies(scene_state, stats);
+  }
+
+  if (scene_state.solve_stages.empty()) {
+    solveSceneParts(scene_state, variable_indices, options, limits, stats);
+  }
+  else {
+    solveStages(scene_state, variable_indices, options, limits, stats);
+    SolveStats final_stats;
+
+    solveSceneParts(
+      scene_state,
+      variable_indices,
+      options,
+      limits.afterEvaluations(stats.n_evaluations),
+      final_stats
+    );
+
+    addStageStats(stats, final_stats);
+    stats.n_pruned_variables = final_stats.n_pruned_variables;
+    const vector<float> &final_history = final_stats.error_history;
+
+    if (!final_history.empty()) {
+      stats.error_history.insert(
+        stats.error_history.end(),
+        final_history.begin() + 1,
+        final_history.end()
+      );
+    }
+  }
+
+  stats.n_variables = variable_indices.n_variables;
+  stats.was_cancelled = isCancelled(options.cancel_flag_ptr);
+  stats.total_seconds = secondsSince(start_time);
+  return stats;
+}
+
+
+
+// The damping keeps the step small along directions that the distance
+// errors barely constrain, relative to the average curvature.
+static const float preview_relative_damping = 1e-3;
+
+
+struct SolvePreview::Data {
+  vector<bool> solve_flags;
+  Eigen::Index n_residuals = 0;
+  Eigen::MatrixXf jacobian;
+  Eigen::LDLT<Eigen::MatrixXf> normal_factorization;
+};
+
+
+static vector<bool> sceneSolveFlags(const SceneState &scene_state)
+{
+  vector<bool> result;
+
+  forEachSceneValue(
+    scene_state,
+    [&](const float &, bool solve_flag, float){
+      result.push_back(solve_flag);
+    }
+  );
+
+  return result;
+}
+
+
+bool SolvePreview::canPreview(const SceneState &scene_state)
+{
+  return variableIndices(scene_state).n_variables <= size_t(max_variables);
+}
+
+
+SolvePreview::SolvePreview(const SceneState &scene_state)
+{
+  assert(canPreview(scene_state));
+  auto data = std::make_shared<Data>();
+  data->solve_flags = sceneSolveFlags(scene_state);
+  data->n_residuals = nResiduals(scene_state);
+  VariableIndices variable_indices = variableIndices(scene_state);
+  GlobalTransformCache cache(scene_state);
+  Eigen::VectorXf residuals;
+
+  evaluateResiduals(
+    scene_state, cache, variable_indices, residuals, &data->jacobian
+  );
+
+  Eigen::MatrixXf normal = data->jacobian.transpose()*data->jacobian;
+  Eigen::Index n_variables = normal.rows();
+
+  if (n_variables != 0) {
+    float damping =
+      preview_relative_damping*normal.diagonal().sum()/n_variables +
+      std::numeric_limits<float>::min();
+
+    normal.diagonal().array() += damping;
+  }
+
+  data->normal_factorization.compute(normal);
+  data_ptr = data;
+}
+
+
+bool SolvePreview::isValidFor(const SceneState &scene_state) const
+{
+  return
+    sceneSolveFlags(scene_state) == data_ptr->solve_flags &&
+    nResiduals(scene_state) == data_ptr->n_residuals;
+}
+
+
+void SolvePreview::apply(SceneState &scene_state) const
+{
+  assert(isValidFor(scene_state));
+  const Data &data = *data_ptr;
+  VariableIndices variable_indices = variableIndices(scene_state);
+  GlobalTransformCache cache(scene_state);
+  Eigen::VectorXf residuals;
+
+  evaluateResiduals(
+    scene_state, cache, variable_indices, residuals,
+    static_cast<Eigen::MatrixXf *>(nullptr)
+  );
+
+  Eigen::VectorXf step =
+    -data.normal_factorization.solve(data.jacobian.transpose()*residuals);
+
+  vector<float> variables;
+
+  forEachSceneValue(
+    scene_state,
+    [&](const float &value, bool solve_flag, float scale){
+      getValue(variables, value, scale, solve_flag);
+    }
+  );
+
+  for (auto i : indicesOf(variables)) {
+    variables[i] += step[i];
+  }
 
-  minimize(f, variables);
   updateState(scene_state, variables);
   updateErrorsInState(scene_state);
 }
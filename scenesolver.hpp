@@ -1,3 +1,106 @@
+#ifndef SCENESOLVER_HPP_
+#define SCENESOLVER_HPP_
+
+#include <atomic>
+#include <memory>
 #include "scenestate.hpp"
+#include "solvestats.hpp"
+
+class ThreadPool;
+
+// levenberg_marquardt switches to sparse normal equations for scenes with
+// many variables, and sparse_levenberg_marquardt always uses them.  For a
+// serial chain of solved rotations, levenberg_marquardt instead takes the
+// jacobian directly from the joints, and solves for each step with
+// equations the size of the residuals when there are fewer of them than
+// variables.
+enum class SolveMethod {
+  coordinate_descent,
+  levenberg_marquardt,
+  sparse_levenberg_marquardt
+};
+
+
+struct SolveOptions {
+  SolveMethod method = SolveMethod::levenberg_marquardt;
+
+  // If set, the Levenberg-Marquardt jacobian is found from central
+  // differences of the residuals instead of from the analytic derivatives,
+  // which is slower, but doesn't need the derivatives of each kind of
+  // distance error.
+  bool finite_difference_jacobian = false;
+
+  // If given, independent parts of the scene are solved concurrently, with
+  // each thread using its own copy of the scene.  A part that is solved on
+  // its own finds the columns of a finite difference jacobian concurrently
+  // instead, with each thread using its own copy of the solve plan.
+  ThreadPool *thread_pool_ptr = nullptr;
+
+  // Variables that don't affect any of the same distance errors, directly
+  // or through other variables, are solved as separate problems.  Since
+  // the total error is the sum of the errors of each part, the parts have
+  // the same minimum either way, but the values found can differ slightly,
+  // since the steps and stopping points of the solvers depend on the whole
+  // problem, like the damping of Levenberg-Marquardt and when coordinate
+  // descent stops finding improvements.  Variables that don't affect any
+  // distance error aren't solved either way.
+  bool split_into_components = true;
+
+  // If given, the solve stops soon after the flag is set, possibly from
+  // another thread, leaving the scene with the best values found so far.
+  const std::atomic<bool> *cancel_flag_ptr = nullptr;
+
+  // If given, the solve stops once it has taken this long or evaluated
+  // the error this many times, leaving the scene with the best values found
+  // so far, so that solving again continues from there.  Independent parts
+  // of the scene share the time budget, but each gets the full evaluation
+  // budget.
+  Optional<double> maybe_time_budget_seconds;
+  Optional<int> maybe_evaluation_budget;
+
+  // Before solving, each body whose translation and rotation are all
+  // solved is moved to the rigid transform that best fits its markers to
+  // the fixed markers that they have distance errors with, which gets
+  // badly placed bodies close to the solution without iterating.
+  bool align_rigid_bodies_first = false;
+};
+
+
+// If the scene has solve stages, each stage is solved in order before the
+// whole scene is solved, so that small local problems can converge before
+// the coupled problem that joins them.
+extern SolveStats
+  solveScene(SceneState &, const SolveOptions & = SolveOptions());
+
+
+// A linear model of how the solved values respond to changes in the
+// distance errors, made from the jacobian of the residuals at a scene
+// state, usually one that was just solved.  Applying it takes a damped
+// Gauss-Newton step for the current residuals with the saved
+// factorization, which only needs a single evaluation of the residuals,
+// so it can estimate the solve for each motion of a drag while the real
+// solve runs less often.  It is only valid for scenes with the same solve
+// flags and distance errors.
+class SolvePreview {
+  public:
+    // Making a preview factors a dense matrix with a row and column for
+    // each solved value, so scenes with more solved values than this
+    // aren't previewed, since the factorization would take longer than
+    // solving.
+    static const int max_variables = 100;
+
+    static bool canPreview(const SceneState &);
+
+    explicit SolvePreview(const SceneState &);
+
+    bool isValidFor(const SceneState &) const;
+
+    // Moves the solved values by the step and updates the errors.
+    void apply(SceneState &) const;
+
+  private:
+    struct Data;
+    std::shared_ptr<const Data> data_ptr;
+};
 
-extern void solveScene(SceneState &);
+#endif /* SCENESOLVER_HPP_ */
@@ -15,6 +15,8 @@
 #include "positionstatepoint3.hpp"
 #include "randomvec3.hpp"
 #include "pointlink.hpp"
+#include "threadpool.hpp"
+#include "solveplan.hpp"
 
 using std::cerr;
 
@@ -105,10 +107,11 @@ static TransformState randomUnscaledTransformState(RandomEngine &engine)
 }
 
 
-static Example makeExample(RandomEngine &engine)
+// Adds distance errors that would be solved with the example's body at a
+// random transform, then moves the body to some other random transform.
+static void addRandomDistanceErrors(Example &example, RandomEngine &engine)
 {
-  Example result;
-  SceneState &scene_state = result.scene_state;
+  SceneState &scene_state = example.scene_state;
 
   // Create a random transform and three random global points, then find the
   // equvalent local points and setup the scene from that.
@@ -119,19 +122,36 @@ static Example makeExample(RandomEngine &engine)
   Point3 local1 = localizePoint3(global1, true_box_global);
   Point3 local2 = localizePoint3(global2, true_box_global);
   Point3 local3 = localizePoint3(global3, true_box_global);
-  result.addDistanceError(local1,global1);
-  result.addDistanceError(local2,global2);
-  result.addDistanceError(local3,global3);
+  example.addDistanceError(local1,global1);
+  example.addDistanceError(local2,global2);
+  example.addDistanceError(local3,global3);
 
   // Then we can set the box global transform to some other random
   // transform.
 
-  SceneState::Body &body_state = scene_state.body(result.body_index);
+  SceneState::Body &body_state = scene_state.body(example.body_index);
   body_state.transform = randomUnscaledTransformState(engine);
+}
+
+
+static Example makeExample(RandomEngine &engine)
+{
+  Example result;
+  addRandomDistanceErrors(result, engine);
   return result;
 }
 
 
+// Two boxes where the distance errors for each only involve that box.
+static SceneState makeTwoBoxScene(RandomEngine &engine)
+{
+  Example example = makeExample(engine);
+  example.body_index = Example::createBody(example.scene_state);
+  addRandomDistanceErrors(example, engine);
+  return example.scene_state;
+}
+
+
 static void clearAll(SceneState::TransformSolveFlags &flags)
 {
   setAll(flags, false);
@@ -149,6 +169,283 @@ static void testSolvingBoxTransform()
 }
 
 
+static void testSolvingBoxTransformWithCoordinateDescent()
+{
+  RandomEngine engine(/*seed*/1);
+  SceneState scene_state = makeExample(engine).scene_state;
+  SolveOptions options;
+  options.method = SolveMethod::coordinate_descent;
+  solveScene(scene_state, options);
+  updateErrorsInState(scene_state);
+  float error = sceneError(scene_state);
+  assert(error < 0.003);
+}
+
+
+static void
+  assertNearTransform(
+    const TransformState &a,
+    const TransformState &b,
+    float tolerance
+  )
+{
+  forEachXYZComponent([&](XYZComponent c){
+    assertNear(
+      component(a.translation, c), component(b.translation, c), tolerance
+    );
+
+    assertNear(component(a.rotation, c), component(b.rotation, c), tolerance);
+  });
+}
+
+
+static void testSolvingBoxTransformWithFiniteDifferences()
+{
+  RandomEngine engine(/*seed*/1);
+  SceneState initial_state = makeExample(engine).scene_state;
+  SceneState analytic_state = initial_state;
+  solveScene(analytic_state);
+  ThreadPool thread_pool(/*n_threads*/4);
+
+  for (ThreadPool *thread_pool_ptr : {(ThreadPool *)nullptr, &thread_pool}) {
+    SceneState scene_state = initial_state;
+    SolveOptions options;
+    options.finite_difference_jacobian = true;
+    options.thread_pool_ptr = thread_pool_ptr;
+    SolveStats stats = solveScene(scene_state, options);
+    assert(sceneError(scene_state) < 0.003);
+
+    // Each jacobian evaluates the residuals twice for each variable.
+    assert(stats.n_evaluations > 2*stats.n_variables);
+
+    assertNearTransform(
+      scene_state.body(0).transform,
+      analytic_state.body(0).transform,
+      /*tolerance*/0.01
+    );
+  }
+}
+
+
+static void testAligningRigidBodiesFirst()
+{
+  RandomEngine engine(/*seed*/1);
+  SceneState scene_state = makeExample(engine).scene_state;
+  SceneState unaligned_state = scene_state;
+  SolveOptions options;
+  options.method = SolveMethod::coordinate_descent;
+  SolveStats unaligned_stats = solveScene(unaligned_state, options);
+  options.align_rigid_bodies_first = true;
+  SolveStats stats = solveScene(scene_state, options);
+
+  // The markers can be matched exactly, so the alignment alone finds the
+  // solution.
+  assertNear(stats.error_history[0], 0, 1e-6);
+  assert(stats.n_evaluations < unaligned_stats.n_evaluations);
+  assert(sceneError(scene_state) < 1e-6);
+}
+
+
+static void testSolveStats()
+{
+  for (SolveMethod method : {
+    SolveMethod::coordinate_descent, SolveMethod::levenberg_marquardt
+  }) {
+    RandomEngine engine(/*seed*/1);
+    SceneState scene_state = makeExample(engine).scene_state;
+    SolveOptions options;
+    options.method = method;
+    SolveStats stats = solveScene(scene_state, options);
+    assert(stats.n_variables == 6);
+    assert(stats.n_iterations > 0);
+    assert(stats.n_evaluations > stats.n_iterations);
+    assert(int(stats.error_history.size()) == stats.n_iterations + 1);
+    assert(stats.error_history.back() <= stats.error_history.front());
+    assert(stats.total_seconds >= stats.error_seconds);
+  }
+}
+
+
+static void testSolvingSeparateBodies()
+{
+  for (SolveMethod method : {
+    SolveMethod::coordinate_descent, SolveMethod::levenberg_marquardt
+  }) {
+    RandomEngine engine(/*seed*/1);
+    SceneState scene_state = makeTwoBoxScene(engine);
+    ThreadPool thread_pool(/*n_threads*/2);
+    SolveOptions options;
+    options.method = method;
+    options.thread_pool_ptr = &thread_pool;
+    SceneState joint_state = scene_state;
+    SolveOptions joint_options = options;
+    joint_options.split_into_components = false;
+    solveScene(joint_state, joint_options);
+    SolveStats stats = solveScene(scene_state, options);
+    assert(stats.n_variables == 12);
+    assert(int(stats.error_history.size()) == stats.n_iterations + 1);
+    assertNear(stats.error_history.back(), sceneError(scene_state), 1e-6);
+
+    if (method == SolveMethod::coordinate_descent) {
+      // Coordinate descent stalls before it converges, and where it stalls
+      // depends on rounding, so we can only expect similar errors.
+      assertNear(sceneError(scene_state), sceneError(joint_state), 1e-3);
+      continue;
+    }
+
+    for (auto body_index : indicesOf(scene_state.bodies())) {
+      assertNearTransform(
+        scene_state.body(body_index).transform,
+        joint_state.body(body_index).transform,
+        /*tolerance*/0.01
+      );
+    }
+  }
+}
+
+
+static void testPruningVariablesWithoutErrors()
+{
+  for (bool split : {true, false}) {
+    RandomEngine engine(/*seed*/1);
+    SceneState scene_state = makeExample(engine).scene_state;
+    SceneState expected_state = scene_state;
+    solveScene(expected_state);
+    BodyIndex unused_body_index = scene_state.createBody();
+
+    scene_state.body(unused_body_index).solve_flags.translation =
+      {true, true, true};
+
+    SolveOptions options;
+    options.split_into_components = split;
+    SolveStats stats = solveScene(scene_state, options);
+    assert(stats.n_variables == 9);
+    assert(stats.n_pruned_variables == 3);
+    assert(int(stats.error_history.size()) == stats.n_iterations + 1);
+    assertNear(sceneError(scene_state), sceneError(expected_state), 1e-6);
+
+    assertNear(
+      scene_state.body(unused_body_index).transform.translation.x, 0, 0
+    );
+  }
+}
+
+
+static void testSolvePreview()
+{
+  RandomEngine engine(/*seed*/1);
+  SceneState scene_state = makeExample(engine).scene_state;
+  solveScene(scene_state);
+  SolvePreview preview(scene_state);
+  assert(preview.isValidFor(scene_state));
+
+  // Move the global markers a little, as if they were being dragged.
+  for (auto marker_index : indicesOf(scene_state.markers())) {
+    SceneState::Marker &marker_state = scene_state.marker(marker_index);
+
+    if (!marker_state.maybe_body_index) {
+      marker_state.position.x += 0.01;
+    }
+  }
+
+  updateErrorsInState(scene_state);
+  float moved_error = scene_state.total_error;
+  assert(moved_error > 1e-5);
+  preview.apply(scene_state);
+  assert(scene_state.total_error < moved_error*0.01);
+
+  scene_state.body(0).solve_flags.scale = true;
+  assert(!preview.isValidFor(scene_state));
+  assert(SolvePreview::canPreview(scene_state));
+
+  // Scenes with too many solved values aren't previewed.
+  for (int i = 0; i != SolvePreview::max_variables; ++i) {
+    BodyIndex body_index = scene_state.createBody();
+    scene_state.body(body_index).solve_flags.scale = true;
+  }
+
+  assert(!SolvePreview::canPreview(scene_state));
+}
+
+
+static void testSolvingInStages()
+{
+  RandomEngine engine(/*seed*/1);
+  SceneState scene_state = makeTwoBoxScene(engine);
+  scene_state.body(0).solve_flags.tags = {"first"};
+  scene_state.body(1).solve_flags.tags = {"second"};
+
+  // The first three distance errors are for the first box.
+  for (auto index : indicesOf(scene_state.distance_errors)) {
+    scene_state.distance_errors[index].tags = {index < 3 ? "first" : "second"};
+  }
+
+  scene_state.solve_stages.push_back({{"first"}});
+  scene_state.solve_stages.push_back({{"second"}});
+  SolveStats stats = solveScene(scene_state, SolveOptions());
+  const vector<float> &history = stats.error_history;
+
+  // The first stage only improves the first box, and the second stage
+  // solves the rest, so the final solve has nothing left to do.
+  assert(history.size() >= 3);
+  assert(history[1] < history[0]);
+  assert(history[2] < history[1]);
+  assertNear(history[2], 0, 1e-6);
+  assertNear(history.back(), sceneError(scene_state), 1e-6);
+  assert(stats.n_variables == 12);
+}
+
+
+static void testCancellingASolve()
+{
+  for (SolveMethod method : {
+    SolveMethod::coordinate_descent, SolveMethod::levenberg_marquardt
+  }) {
+    RandomEngine engine(/*seed*/1);
+    SceneState scene_state = makeExample(engine).scene_state;
+    std::atomic<bool> cancel_flag{true};
+    SolveOptions options;
+    options.method = method;
+    options.cancel_flag_ptr = &cancel_flag;
+    SolveStats stats = solveScene(scene_state, options);
+    assert(stats.was_cancelled);
+    assert(stats.n_iterations <= 1);
+  }
+}
+
+
+static void testSolvingWithABudget()
+{
+  RandomEngine engine(/*seed*/1);
+  SceneState scene_state = makeExample(engine).scene_state;
+  updateErrorsInState(scene_state);
+  float initial_error = sceneError(scene_state);
+  SolveOptions options;
+  options.method = SolveMethod::coordinate_descent;
+  options.maybe_evaluation_budget = 20;
+  SolveStats stats = solveScene(scene_state, options);
+  assert(stats.ran_out_of_budget);
+  float budgeted_error = sceneError(scene_state);
+  assert(budgeted_error < initial_error);
+
+  // Solving again continues from where the last solve stopped.
+  stats = solveScene(scene_state, options);
+  assertNear(stats.error_history.front(), budgeted_error, 1e-6);
+  assert(sceneError(scene_state) < budgeted_error);
+
+  options.maybe_evaluation_budget.reset();
+  options.maybe_time_budget_seconds = 0;
+  stats = solveScene(scene_state, options);
+  assert(stats.ran_out_of_budget);
+  assert(stats.n_iterations == 0);
+
+  options.maybe_time_budget_seconds.reset();
+  stats = solveScene(scene_state, options);
+  assert(!stats.ran_out_of_budget);
+  assert(sceneError(scene_state) < 0.003);
+}
+
+
 static void testSolvingBoxTransformWithoutXTranslation()
 {
   RandomEngine engine(/*seed*/1);
@@ -259,10 +556,131 @@ static void testSolvingScale()
 }
 
 
+// Makes a chain of bodies, with a marker on the end that should reach a
+// global marker.  Each body can rotate, and can also translate if
+// solve_translations is set.
+static SceneState makeChainScene(int n_bodies, bool solve_translations)
+{
+  SceneState scene_state;
+  Optional<BodyIndex> maybe_parent_index;
+
+  for (int i = 0; i != n_bodies; ++i) {
+    BodyIndex body_index = createBodyIn(scene_state, maybe_parent_index);
+    SceneState::Body &body_state = scene_state.body(body_index);
+    clearAll(body_state.solve_flags);
+    setAll(body_state.solve_flags.rotation, true);
+    setAll(body_state.solve_flags.translation, solve_translations);
+
+    if (maybe_parent_index) {
+      body_state.transform.translation.x = 1;
+    }
+
+    maybe_parent_index = body_index;
+  }
+
+  MarkerIndex end_marker_index =
+    addMarkerTo(scene_state, {1,0,0}, maybe_parent_index);
+
+  MarkerIndex target_marker_index = addMarkerTo(scene_state, {1,2,3});
+  SceneState::DistanceError &distance_error = createDistanceError(scene_state);
+  distance_error.setStart(Marker(end_marker_index));
+  distance_error.setEnd(Marker(target_marker_index));
+  return scene_state;
+}
+
+
+static float solvedError(SceneState scene_state, const SolveOptions &options)
+{
+  solveScene(scene_state, options);
+  return sceneError(scene_state);
+}
+
+
+static size_t nSolvedVariables(const SceneState &scene_state)
+{
+  return makeSolvePlan(scene_state).variable_value_indices.size();
+}
+
+
+static void testSolvingChain()
+{
+  SceneState scene_state = makeChainScene(/*n_bodies*/5, false);
+  assert(solvedError(scene_state, SolveOptions()) < 1e-6);
+}
+
+
+static void testSolvingSerialChain()
+{
+  // With only rotations, the chain is a serial chain, and its three
+  // residuals are fewer than its fifteen variables, so the underdetermined
+  // step is used.
+  SceneState serial_scene_state = makeChainScene(/*n_bodies*/5, false);
+  assert(isSerialRotationChain(makeSolvePlan(serial_scene_state)));
+  assert(nSolvedVariables(serial_scene_state) == 15);
+
+  // Solving the root translation too, with another distance error holding
+  // the root at the origin, has the same solutions, but isn't a serial
+  // chain, so the dense normal equations are used.
+  SceneState dense_scene_state = serial_scene_state;
+  setAll(dense_scene_state.body(0).solve_flags.translation, true);
+  MarkerIndex root_marker_index = addMarkerTo(dense_scene_state, {0,0,0}, 0);
+  MarkerIndex origin_marker_index = addMarkerTo(dense_scene_state, {0,0,0});
+
+  SceneState::DistanceError &distance_error =
+    createDistanceError(dense_scene_state);
+
+  distance_error.setStart(Marker(root_marker_index));
+  distance_error.setEnd(Marker(origin_marker_index));
+  assert(!isSerialRotationChain(makeSolvePlan(dense_scene_state)));
+
+  SolveOptions options;
+  float serial_error = solvedError(serial_scene_state, options);
+  float dense_error = solvedError(dense_scene_state, options);
+  assert(serial_error < 1e-6);
+  assert(dense_error < 1e-6);
+  assertNear(serial_error, dense_error, 1e-6);
+
+  // Either way works with a finite difference jacobian too.
+  options.finite_difference_jacobian = true;
+  assert(solvedError(serial_scene_state, options) < 1e-6);
+  assert(solvedError(dense_scene_state, options) < 1e-6);
+}
+
+
+static void testSolvingChainWithSparseMethod()
+{
+  SolveOptions options;
+  options.method = SolveMethod::sparse_levenberg_marquardt;
+  SceneState scene_state = makeChainScene(/*n_bodies*/5, false);
+  assert(solvedError(scene_state, options) < 1e-6);
+
+  // With translations, the chain isn't a serial rotation chain, and ten
+  // bodies have enough variables that the sparse method is used by
+  // default.
+  SceneState translating_scene_state = makeChainScene(/*n_bodies*/10, true);
+  assert(!isSerialRotationChain(makeSolvePlan(translating_scene_state)));
+  assert(nSolvedVariables(translating_scene_state) >= 60);
+  assert(solvedError(translating_scene_state, SolveOptions()) < 1e-6);
+}
+
+
 int main()
 {
   testSolvingBoxTransform();
+  testSolvingBoxTransformWithCoordinateDescent();
+  testSolvingBoxTransformWithFiniteDifferences();
+  testAligningRigidBodiesFirst();
+  testSolveStats();
+  testSolvingSeparateBodies();
+  testPruningVariablesWithoutErrors();
+  testSolvePreview();
+  testSolvingInStages();
+  testCancellingASolve();
+  testSolvingWithABudget();
   testSolvingBoxTransformWithoutXTranslation();
   testWithTwoBodies();
   testSolvingScale();
+  testSolvingChain();
+  testSolvingSerialChain();
+  testSolvingChainWithSparseMethod();
 }
@@ -51,6 +51,7 @@ class SceneState {
     using Position = XYZ;
     using Expression = ::Expression;
     using Float = float;
+    using SolveTags = vector<String>;
 
     struct XYZ {
       Float x = 0;
@@ -131,6 +132,10 @@ class SceneState {
       XYZSolveFlags translation;
       XYZSolveFlags rotation;
       bool scale = defaultScale();
+
+      // The solve stages that solve these values, along with the scales of
+      // the body's meshes.
+      SolveTags tags;
     };
 
     struct TransformExpressions {
@@ -226,6 +231,9 @@ class SceneState {
       Float weight = 1;
       Float error = 0;
 
+      // The solve stages that include this error.
+      SolveTags tags;
+
       void setStart(Optional<PointLink> arg)
       {
         optional_start = arg;
@@ -266,8 +274,15 @@ class SceneState {
       Float value = 0;
     };
 
+    // Part of the scene that is solved before the whole scene is solved,
+    // made up of the values and distance errors that have any of the tags.
+    struct SolveStage {
+      SolveTags tags;
+    };
+
     DistanceErrors distance_errors;
     Variables variables;
+    vector<SolveStage> solve_stages;
     Float total_error = 0;
     Optional<BodyMeshPosition> maybe_marked_body_mesh_position;
     Optional<::Marker> maybe_marked_marker;
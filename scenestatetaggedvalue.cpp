@@ -125,6 +125,27 @@ static string
 }
 
 
+// A value for each child with the given tag.
+static SceneState::SolveTags
+  childStringValues(
+    const TaggedValue &tagged_value,
+    const TaggedValue::Tag &child_name
+  )
+{
+  SceneState::SolveTags result;
+
+  for (auto &child : tagged_value.children) {
+    if (child.tag == child_name) {
+      if (const StringValue *string_ptr = child.value.maybeString()) {
+        result.push_back(*string_ptr);
+      }
+    }
+  }
+
+  return result;
+}
+
+
 static SceneState::XYZ xyzStateFromTaggedValue(const TaggedValue &tagged_value)
 {
   NumericValue x = childNumericValueOr(tagged_value, "x", 0);
@@ -275,6 +296,7 @@ static TransformSolveFlags
       tagged_value, "rotation", /*default_value*/true
     );
 
+  result.tags = childStringValues(tagged_value, "solve_tag");
   return result;
 }
 
@@ -745,6 +767,8 @@ createDistanceErrorFromTaggedValue(
       distance_error_state.weight = *optional_value;
     }
   }
+
+  distance_error_state.tags = childStringValues(tagged_value, "solve_tag");
 }
 
 
@@ -1015,6 +1039,21 @@ createVariablesInSceneState(SceneState &result, const TaggedValue &tagged_value)
 }
 
 
+static void
+createSolveStagesInSceneState(
+  SceneState &result, const TaggedValue &tagged_value
+)
+{
+  for (auto &child_tagged_value : tagged_value.children) {
+    if (child_tagged_value.tag == "SolveStage") {
+      SceneState::SolveStage stage;
+      stage.tags = childStringValues(child_tagged_value, "solve_tag");
+      result.solve_stages.push_back(stage);
+    }
+  }
+}
+
+
 SceneState makeSceneStateFromTaggedValue(const TaggedValue &tagged_value)
 {
   SceneState result;
@@ -1040,6 +1079,7 @@ SceneState makeSceneStateFromTaggedValue(const TaggedValue &tagged_value)
     result, tagged_value
   );
 
+  createSolveStagesInSceneState(result, tagged_value);
   return result;
 }
 
@@ -1088,6 +1128,15 @@ static TaggedValue &
 }
 
 
+static void
+  createSolveTags(TaggedValue &parent, const SceneState::SolveTags &tags)
+{
+  for (auto &tag : tags) {
+    create(parent, "solve_tag", tag);
+  }
+}
+
+
 static const bool *
 maybeSolveFlag(
   const SceneState::XYZSolveFlags *xyz_solve_flags_ptr,
@@ -1270,6 +1319,8 @@ static TaggedValue &
         &expressions.scale
       );
     }
+
+    createSolveTags(parent, solve_flags.tags);
   }
 
   return transform;
@@ -1451,6 +1502,7 @@ createDistanceErrorInTaggedValue(
 
     create(parent, "desired_distance", distance_error_state.desired_distance);
     create(parent, "weight", distance_error_state.weight);
+    createSolveTags(parent, distance_error_state.tags);
   }
 }
 
@@ -1566,5 +1618,9 @@ TaggedValue makeTaggedValueForSceneState(const SceneState &scene_state)
     }
   }
 
+  for (const SceneState::SolveStage &stage : scene_state.solve_stages) {
+    createSolveTags(create(result, "SolveStage"), stage.tags);
+  }
+
   return result;
 }
@@ -279,9 +279,33 @@ static void testCreatingABodyFromATaggedValueWithConflictingNames()
 }
 
 
+static void testSolveTags()
+{
+  SceneState scene_state;
+  BodyIndex body_index = createGlobalBodyIn(scene_state);
+  scene_state.body(body_index).solve_flags.tags = {"camera", "rig"};
+  DistanceErrorIndex error_index = scene_state.createDistanceError();
+  scene_state.distance_errors[error_index].tags = {"ray"};
+  scene_state.solve_stages.push_back({{"ray"}});
+  scene_state.solve_stages.push_back({{"camera", "ray"}});
+
+  SceneState new_state =
+    makeSceneStateFromTaggedValue(makeTaggedValueForSceneState(scene_state));
+
+  using Tags = SceneState::SolveTags;
+  const Tags &body_tags = new_state.body(body_index).solve_flags.tags;
+  assert(body_tags == Tags({"camera", "rig"}));
+  assert(new_state.distance_errors[error_index].tags == Tags({"ray"}));
+  assert(new_state.solve_stages.size() == 2);
+  assert(new_state.solve_stages[0].tags == Tags({"ray"}));
+  assert(new_state.solve_stages[1].tags == Tags({"camera", "ray"}));
+}
+
+
 int main()
 {
   testCreatingABodyFromATaggedValue();
   testCreatingABodyFromATaggedValueWithConflictingNames();
   testBody();
+  testSolveTags();
 }
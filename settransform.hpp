@@ -1,10 +0,0 @@
-#include "scene.hpp"
-#include "transform.hpp"
-
-
-extern void
-  setTransform(
-    Scene::TransformHandle transform_id,
-    const Transform &transform_value,
-    Scene &scene
-  );
@@ -0,0 +1,79 @@
+#include "solvedvalues.hpp"
+
+#include "indicesof.hpp"
+
+
+bool
+  haveSameBodiesAndMeshes(const SceneState &state1, const SceneState &state2)
+{
+  if (state1.bodies().size() != state2.bodies().size()) {
+    return false;
+  }
+
+  for (auto body_index : indicesOf(state1.bodies())) {
+    const SceneState::Body &body1 = state1.body(body_index);
+    const SceneState::Body &body2 = state2.body(body_index);
+
+    if (body1.maybe_parent_index != body2.maybe_parent_index) {
+      return false;
+    }
+
+    if (body1.meshes.size() != body2.meshes.size()) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+static void
+  copySolvedXYZValues(
+    const SceneState::XYZ &solved_values,
+    const SceneState::XYZSolveFlags &solve_flags,
+    SceneState::XYZ &values
+  )
+{
+  forEachXYZComponent([&](XYZComponent c){
+    if (solve_flags.component(c)) {
+      component(values, c) = component(solved_values, c);
+    }
+  });
+}
+
+
+void
+  copySolvedValues(const SceneState &solved_state, SceneState &scene_state)
+{
+  for (auto body_index : indicesOf(solved_state.bodies())) {
+    const SceneState::Body &solved_body = solved_state.body(body_index);
+    const SceneState::TransformSolveFlags &flags = solved_body.solve_flags;
+    SceneState::Body &body_state = scene_state.body(body_index);
+
+    copySolvedXYZValues(
+      solved_body.transform.translation,
+      flags.translation,
+      body_state.transform.translation
+    );
+
+    copySolvedXYZValues(
+      solved_body.transform.rotation,
+      flags.rotation,
+      body_state.transform.rotation
+    );
+
+    if (flags.scale) {
+      body_state.transform.scale = solved_body.transform.scale;
+    }
+
+    for (auto mesh_index : indicesOf(solved_body.meshes)) {
+      const SceneState::Mesh &solved_mesh = solved_body.meshes[mesh_index];
+
+      copySolvedXYZValues(
+        solved_mesh.scale,
+        solved_mesh.scale_solve_flags,
+        body_state.meshes[mesh_index].scale
+      );
+    }
+  }
+}
@@ -0,0 +1,17 @@
+#ifndef SOLVEDVALUES_HPP_
+#define SOLVEDVALUES_HPP_
+
+#include "scenestate.hpp"
+
+
+// Whether the scenes have the same bodies, with the same parents, and the
+// same number of meshes on each, so that values can be copied between
+// them.
+extern bool
+  haveSameBodiesAndMeshes(const SceneState &, const SceneState &);
+
+// Copies the values that are solved in solved_state.
+extern void
+  copySolvedValues(const SceneState &solved_state, SceneState &scene_state);
+
+#endif /* SOLVEDVALUES_HPP_ */
@@ -0,0 +1,227 @@
+#include "solvefingerprint.hpp"
+
+using std::string;
+using XYZ = SceneState::XYZ;
+using XYZSolveFlags = SceneState::XYZSolveFlags;
+
+
+namespace {
+// FNV-1a, which is simple and good enough for telling whether anything
+// changed.
+struct FingerprintHasher {
+  SolveFingerprint fingerprint = 14695981039346656037ull;
+
+  void addBytes(const void *data, size_t n_bytes)
+  {
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+
+    for (size_t i = 0; i != n_bytes; ++i) {
+      fingerprint ^= bytes[i];
+      fingerprint *= 1099511628211ull;
+    }
+  }
+
+  void addInt(int value)
+  {
+    addBytes(&value, sizeof value);
+  }
+
+  void addFloat(float value)
+  {
+    addBytes(&value, sizeof value);
+  }
+
+  void addFlag(bool value)
+  {
+    addInt(value ? 1 : 0);
+  }
+
+  void addXYZ(const XYZ &xyz)
+  {
+    addFloat(xyz.x);
+    addFloat(xyz.y);
+    addFloat(xyz.z);
+  }
+
+  void addFlags(const XYZSolveFlags &flags)
+  {
+    addFlag(flags.x);
+    addFlag(flags.y);
+    addFlag(flags.z);
+  }
+
+  void addMaybeIndex(const Optional<int> &maybe_index)
+  {
+    addInt(maybe_index ? *maybe_index : -1);
+  }
+
+  void addString(const string &s)
+  {
+    addInt(s.size());
+    addBytes(s.data(), s.size());
+  }
+
+  void addTags(const SceneState::SolveTags &tags)
+  {
+    addInt(tags.size());
+
+    for (const string &tag : tags) {
+      addString(tag);
+    }
+  }
+};
+}
+
+
+static void
+  markBodyAndAncestors(
+    Optional<BodyIndex> maybe_body_index,
+    const SceneState &scene_state,
+    vector<bool> &is_used
+  )
+{
+  while (maybe_body_index && !is_used[*maybe_body_index]) {
+    is_used[*maybe_body_index] = true;
+    maybe_body_index = scene_state.body(*maybe_body_index).maybe_parent_index;
+  }
+}
+
+
+static Optional<BodyIndex>
+  maybePointBodyIndex(const PointLink &point, const SceneState &scene_state)
+{
+  if (point.maybe_marker) {
+    return scene_state.marker(point.maybe_marker->index).maybe_body_index;
+  }
+
+  if (point.maybe_body_mesh_position) {
+    return point.maybe_body_mesh_position->array.body_mesh.body.index;
+  }
+
+  return {};
+}
+
+
+static vector<bool> usedBodies(const SceneState &scene_state)
+{
+  vector<bool> is_used(scene_state.bodies().size(), false);
+
+  for (auto &distance_error_state : scene_state.distance_errors) {
+    for (
+      const Optional<PointLink> *maybe_point_ptr : {
+        &distance_error_state.optional_start,
+        &distance_error_state.optional_end
+      }
+    ) {
+      if (*maybe_point_ptr) {
+        markBodyAndAncestors(
+          maybePointBodyIndex(**maybe_point_ptr, scene_state),
+          scene_state,
+          is_used
+        );
+      }
+    }
+  }
+
+  return is_used;
+}
+
+
+static void
+  addPoint(
+    const Optional<PointLink> &maybe_point,
+    const SceneState &scene_state,
+    FingerprintHasher &hasher
+  )
+{
+  if (!maybe_point) {
+    hasher.addInt(0);
+  }
+  else if (maybe_point->maybe_marker) {
+    MarkerIndex marker_index = maybe_point->maybe_marker->index;
+    const SceneState::Marker &marker_state = scene_state.marker(marker_index);
+    hasher.addInt(1);
+    hasher.addInt(marker_index);
+    hasher.addMaybeIndex(marker_state.maybe_body_index);
+    hasher.addXYZ(marker_state.position);
+  }
+  else if (maybe_point->maybe_body_mesh_position) {
+    const BodyMeshPosition &body_mesh_position =
+      *maybe_point->maybe_body_mesh_position;
+
+    BodyIndex body_index = body_mesh_position.array.body_mesh.body.index;
+    MeshIndex mesh_index = body_mesh_position.array.body_mesh.index;
+    MeshPositionIndex position_index = body_mesh_position.index;
+
+    const SceneState::Mesh &mesh_state =
+      scene_state.body(body_index).meshes[mesh_index];
+
+    hasher.addInt(2);
+    hasher.addInt(body_index);
+    hasher.addInt(mesh_index);
+    hasher.addInt(position_index);
+    hasher.addXYZ(mesh_state.shape.positions[position_index]);
+  }
+  else {
+    assert(false);
+  }
+}
+
+
+static void
+  addBody(
+    BodyIndex body_index,
+    const SceneState &scene_state,
+    FingerprintHasher &hasher
+  )
+{
+  const SceneState::Body &body_state = scene_state.body(body_index);
+  const SceneState::TransformSolveFlags &solve_flags = body_state.solve_flags;
+  hasher.addInt(body_index);
+  hasher.addMaybeIndex(body_state.maybe_parent_index);
+  hasher.addXYZ(body_state.transform.translation);
+  hasher.addXYZ(body_state.transform.rotation);
+  hasher.addFloat(body_state.transform.scale);
+  hasher.addFlags(solve_flags.translation);
+  hasher.addFlags(solve_flags.rotation);
+  hasher.addFlag(solve_flags.scale);
+  hasher.addTags(solve_flags.tags);
+  hasher.addInt(body_state.meshes.size());
+
+  for (const SceneState::Mesh &mesh_state : body_state.meshes) {
+    hasher.addXYZ(mesh_state.scale);
+    hasher.addXYZ(mesh_state.center);
+    hasher.addFlags(mesh_state.scale_solve_flags);
+  }
+}
+
+
+SolveFingerprint solveFingerprint(const SceneState &scene_state)
+{
+  FingerprintHasher hasher;
+  vector<bool> is_used = usedBodies(scene_state);
+
+  for (auto body_index : indicesOf(scene_state.bodies())) {
+    if (is_used[body_index]) {
+      addBody(body_index, scene_state, hasher);
+    }
+  }
+
+  hasher.addInt(scene_state.distance_errors.size());
+
+  for (auto &distance_error_state : scene_state.distance_errors) {
+    addPoint(distance_error_state.optional_start, scene_state, hasher);
+    addPoint(distance_error_state.optional_end, scene_state, hasher);
+    hasher.addFloat(distance_error_state.desired_distance);
+    hasher.addFloat(distance_error_state.weight);
+    hasher.addTags(distance_error_state.tags);
+  }
+
+  hasher.addInt(scene_state.solve_stages.size());
+
+  for (auto &solve_stage : scene_state.solve_stages) {
+    hasher.addTags(solve_stage.tags);
+  }
+
+  return hasher.fingerprint;
+}
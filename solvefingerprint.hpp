@@ -0,0 +1,19 @@
+#ifndef SOLVEFINGERPRINT_HPP_
+#define SOLVEFINGERPRINT_HPP_
+
+#include <cstdint>
+#include "scenestate.hpp"
+
+using SolveFingerprint = uint64_t;
+
+// A hash of everything in the scene state that solving depends on: the
+// distance errors, the markers and mesh positions that they use, the
+// transforms of the bodies that those points are on and their ancestors,
+// and the solve flags, tags and stages.  Values that no distance error
+// depends on, such as names, box scales and bodies that no error is
+// attached to, aren't included, so changing them doesn't change the
+// fingerprint.  Solving isn't going to change a scene whose fingerprint is
+// the same as it was after it was last solved.
+extern SolveFingerprint solveFingerprint(const SceneState &);
+
+#endif /* SOLVEFINGERPRINT_HPP_ */
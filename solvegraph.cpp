@@ -0,0 +1,285 @@
+#include "solvegraph.hpp"
+
+#include "indicesof.hpp"
+
+
+namespace {
+struct ErrorsByElement {
+  vector<vector<DistanceErrorIndex>> body_errors;
+  vector<vector<vector<DistanceErrorIndex>>> mesh_errors;
+};
+}
+
+
+static void
+  addBodyErrorIfNew(
+    vector<DistanceErrorIndex> &errors,
+    DistanceErrorIndex error_index
+  )
+{
+  if (errors.empty() || errors.back() != error_index) {
+    errors.push_back(error_index);
+  }
+}
+
+
+static Optional<BodyIndex>
+  maybePointBodyIndex(const PointLink &point, const SceneState &scene_state)
+{
+  if (point.maybe_marker) {
+    return scene_state.marker(point.maybe_marker->index).maybe_body_index;
+  }
+
+  if (point.maybe_body_mesh_position) {
+    return point.maybe_body_mesh_position->array.body_mesh.body.index;
+  }
+
+  assert(false); // not implemented
+  return {};
+}
+
+
+// A point is affected by its body and all the body's ancestors.  Once we
+// reach a body that already has the error, the rest of the chain is
+// shared with the other point of the distance error.
+static void
+  addPointErrors(
+    const PointLink &point,
+    DistanceErrorIndex error_index,
+    const SceneState &scene_state,
+    ErrorsByElement &errors_by_element
+  )
+{
+  Optional<BodyIndex> maybe_body_index =
+    maybePointBodyIndex(point, scene_state);
+
+  while (maybe_body_index) {
+    vector<DistanceErrorIndex> &errors =
+      errors_by_element.body_errors[*maybe_body_index];
+
+    if (!errors.empty() && errors.back() == error_index) {
+      break;
+    }
+
+    errors.push_back(error_index);
+
+    maybe_body_index =
+      scene_state.body(*maybe_body_index).maybe_parent_index;
+  }
+
+  if (point.maybe_body_mesh_position) {
+    BodyMesh body_mesh = point.maybe_body_mesh_position->array.body_mesh;
+
+    addBodyErrorIfNew(
+      errors_by_element.mesh_errors[body_mesh.body.index][body_mesh.index],
+      error_index
+    );
+  }
+}
+
+
+static ErrorsByElement errorsByElement(const SceneState &scene_state)
+{
+  ErrorsByElement result;
+  result.body_errors.resize(scene_state.bodies().size());
+  result.mesh_errors.resize(scene_state.bodies().size());
+
+  for (auto body_index : indicesOf(scene_state.bodies())) {
+    result.mesh_errors[body_index].resize(
+      scene_state.body(body_index).meshes.size()
+    );
+  }
+
+  for (auto error_index : indicesOf(scene_state.distance_errors)) {
+    const SceneState::DistanceError &distance_error =
+      scene_state.distance_errors[error_index];
+
+    // Without both points, the error is always zero.
+    if (!distance_error.hasStart() || !distance_error.hasEnd()) {
+      continue;
+    }
+
+    addPointErrors(
+      *distance_error.optional_start, error_index, scene_state, result
+    );
+
+    addPointErrors(
+      *distance_error.optional_end, error_index, scene_state, result
+    );
+  }
+
+  return result;
+}
+
+
+SolveGraph
+  makeSolveGraph(
+    const vector<SolveVariableOwner> &variable_owners,
+    const SceneState &scene_state
+  )
+{
+  ErrorsByElement errors_by_element = errorsByElement(scene_state);
+  SolveGraph graph;
+
+  for (const SolveVariableOwner &owner : variable_owners) {
+    if (owner.maybe_mesh_index) {
+      graph.variable_errors.push_back(
+        errors_by_element
+        .mesh_errors[owner.body_index][*owner.maybe_mesh_index]
+      );
+    }
+    else {
+      graph.variable_errors.push_back(
+        errors_by_element.body_errors[owner.body_index]
+      );
+    }
+  }
+
+  return graph;
+}
+
+
+static size_t rootVariable(vector<size_t> &parents, size_t variable_index)
+{
+  while (parents[variable_index] != variable_index) {
+    parents[variable_index] = parents[parents[variable_index]];
+    variable_index = parents[variable_index];
+  }
+
+  return variable_index;
+}
+
+
+vector<SolveComponent>
+  solveComponents(const SolveGraph &graph, size_t n_distance_errors)
+{
+  size_t n_variables = graph.variable_errors.size();
+  vector<size_t> parents(n_variables);
+  vector<Optional<size_t>> error_variables(n_distance_errors);
+
+  for (size_t i : indicesOf(parents)) {
+    parents[i] = i;
+  }
+
+  // Join each variable with the first variable found for each of its
+  // errors.  The smaller root is kept so that each component's root is its
+  // first variable.
+  for (size_t i = 0; i != n_variables; ++i) {
+    for (DistanceErrorIndex error_index : graph.variable_errors[i]) {
+      Optional<size_t> &maybe_error_variable = error_variables[error_index];
+
+      if (!maybe_error_variable) {
+        maybe_error_variable = i;
+        continue;
+      }
+
+      size_t root1 = rootVariable(parents, *maybe_error_variable);
+      size_t root2 = rootVariable(parents, i);
+
+      if (root1 < root2) {
+        parents[root2] = root1;
+      }
+      else {
+        parents[root1] = root2;
+      }
+    }
+  }
+
+  vector<SolveComponent> components;
+  vector<Optional<size_t>> root_components(n_variables);
+
+  for (size_t i = 0; i != n_variables; ++i) {
+    if (graph.variable_errors[i].empty()) {
+      continue;
+    }
+
+    Optional<size_t> &maybe_component_index =
+      root_components[rootVariable(parents, i)];
+
+    if (!maybe_component_index) {
+      maybe_component_index = components.size();
+      components.emplace_back();
+    }
+
+    components[*maybe_component_index].variable_indices.push_back(i);
+  }
+
+  for (DistanceErrorIndex error_index : indicesOf(error_variables)) {
+    const Optional<size_t> &maybe_variable_index =
+      error_variables[error_index];
+
+    if (maybe_variable_index) {
+      size_t root = rootVariable(parents, *maybe_variable_index);
+
+      components[*root_components[root]].distance_error_indices.push_back(
+        error_index
+      );
+    }
+  }
+
+  return components;
+}
+
+
+vector<DistanceErrorIndex>
+  bodyDistanceErrors(const SceneState &scene_state, BodyIndex body_index)
+{
+  return errorsByElement(scene_state).body_errors[body_index];
+}
+
+
+vector<bool>
+  bodiesNearErrors(
+    const SceneState &scene_state,
+    const vector<DistanceErrorIndex> &start_error_indices,
+    int max_hops
+  )
+{
+  ErrorsByElement errors_by_element = errorsByElement(scene_state);
+  const auto &body_errors = errors_by_element.body_errors;
+  size_t n_errors = scene_state.distance_errors.size();
+  vector<vector<BodyIndex>> error_bodies(n_errors);
+
+  for (auto body_index : indicesOf(scene_state.bodies())) {
+    for (DistanceErrorIndex error_index : body_errors[body_index]) {
+      error_bodies[error_index].push_back(body_index);
+    }
+  }
+
+  vector<bool> is_near(scene_state.bodies().size(), false);
+  vector<bool> is_reached(n_errors, false);
+  vector<DistanceErrorIndex> errors;
+
+  for (DistanceErrorIndex error_index : start_error_indices) {
+    if (!is_reached[error_index]) {
+      is_reached[error_index] = true;
+      errors.push_back(error_index);
+    }
+  }
+
+  for (int hop = 0; hop != max_hops && !errors.empty(); ++hop) {
+    vector<BodyIndex> new_bodies;
+
+    for (DistanceErrorIndex error_index : errors) {
+      for (BodyIndex body_index : error_bodies[error_index]) {
+        if (!is_near[body_index]) {
+          is_near[body_index] = true;
+          new_bodies.push_back(body_index);
+        }
+      }
+    }
+
+    errors.clear();
+
+    for (BodyIndex body_index : new_bodies) {
+      for (DistanceErrorIndex error_index : body_errors[body_index]) {
+        if (!is_reached[error_index]) {
+          is_reached[error_index] = true;
+          errors.push_back(error_index);
+        }
+      }
+    }
+  }
+
+  return is_near;
+}
@@ -0,0 +1,58 @@
+#ifndef SOLVEGRAPH_HPP_
+#define SOLVEGRAPH_HPP_
+
+#include "scenestate.hpp"
+
+
+// The scene element that a solve variable is a value of.  This is either
+// the transform of a body or, if maybe_mesh_index is set, the scale of one
+// of the body's meshes.
+struct SolveVariableOwner {
+  BodyIndex body_index;
+  Optional<MeshIndex> maybe_mesh_index;
+};
+
+
+// How the solve variables and distance errors depend on each other.
+struct SolveGraph {
+  // For each variable, the distance errors that change when it changes.
+  vector<vector<DistanceErrorIndex>> variable_errors;
+};
+
+
+extern SolveGraph
+  makeSolveGraph(
+    const vector<SolveVariableOwner> &variable_owners,
+    const SceneState &
+  );
+
+
+// Variables and the distance errors that depend on them, where none of the
+// errors depend on variables from other components, so each component can
+// be solved on its own.  The indices are in increasing order.
+struct SolveComponent {
+  vector<size_t> variable_indices;
+  vector<DistanceErrorIndex> distance_error_indices;
+};
+
+
+// Variables that don't affect any distance error aren't in any component.
+// The components are ordered by their first variable.
+extern vector<SolveComponent>
+  solveComponents(const SolveGraph &, size_t n_distance_errors);
+
+// The distance errors that change when any value of the body changes.
+extern vector<DistanceErrorIndex>
+  bodyDistanceErrors(const SceneState &, BodyIndex);
+
+// Whether each body is within max_hops of the start errors, where the
+// bodies that an error depends on are one hop from it, and the errors that
+// depend on those bodies lead to the bodies that are one hop further.
+extern vector<bool>
+  bodiesNearErrors(
+    const SceneState &,
+    const vector<DistanceErrorIndex> &start_error_indices,
+    int max_hops
+  );
+
+#endif /* SOLVEGRAPH_HPP_ */
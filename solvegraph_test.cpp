@@ -0,0 +1,170 @@
+#include "solvegraph.hpp"
+
+#include <cassert>
+
+
+static DistanceErrorIndex
+  createDistanceErrorBetween(
+    SceneState &scene_state,
+    Optional<PointLink> maybe_start,
+    Optional<PointLink> maybe_end
+  )
+{
+  DistanceErrorIndex index = scene_state.createDistanceError();
+  scene_state.distance_errors[index].setStart(maybe_start);
+  scene_state.distance_errors[index].setEnd(maybe_end);
+  return index;
+}
+
+
+static void testVariableErrors()
+{
+  SceneState scene_state;
+  BodyIndex parent_index = scene_state.createBody();
+  BodyIndex child_index = scene_state.createBody(parent_index);
+  BodyIndex other_index = scene_state.createBody();
+  SceneState::MeshShape mesh_shape;
+  MeshIndex mesh_index = scene_state.body(child_index).createMesh(mesh_shape);
+  MarkerIndex global_marker_index = scene_state.createMarker();
+  MarkerIndex child_marker_index = scene_state.createMarker(child_index);
+  MarkerIndex other_marker_index = scene_state.createMarker(other_index);
+
+  DistanceErrorIndex child_error_index =
+    createDistanceErrorBetween(
+      scene_state, PointLink(Marker(child_marker_index)),
+      PointLink(Marker(global_marker_index))
+    );
+
+  DistanceErrorIndex mesh_error_index =
+    createDistanceErrorBetween(
+      scene_state,
+      PointLink(Body(child_index).mesh(mesh_index).position(0)),
+      PointLink(Marker(other_marker_index))
+    );
+
+  // Errors without both points don't depend on anything.
+  createDistanceErrorBetween(
+    scene_state, PointLink(Marker(child_marker_index)), {}
+  );
+
+  vector<SolveVariableOwner> owners = {
+    {parent_index, {}},
+    {child_index, {}},
+    {other_index, {}},
+    {child_index, mesh_index},
+  };
+
+  SolveGraph graph = makeSolveGraph(owners, scene_state);
+  using Errors = vector<DistanceErrorIndex>;
+  assert(graph.variable_errors.size() == owners.size());
+
+  assert(
+    graph.variable_errors[0] == Errors({child_error_index, mesh_error_index})
+  );
+
+  assert(
+    graph.variable_errors[1] == Errors({child_error_index, mesh_error_index})
+  );
+
+  assert(graph.variable_errors[2] == Errors({mesh_error_index}));
+  assert(graph.variable_errors[3] == Errors({mesh_error_index}));
+}
+
+
+static void testErrorWithinOneBody()
+{
+  SceneState scene_state;
+  BodyIndex body_index = scene_state.createBody();
+  MarkerIndex marker1_index = scene_state.createMarker(body_index);
+  MarkerIndex marker2_index = scene_state.createMarker(body_index);
+
+  DistanceErrorIndex error_index =
+    createDistanceErrorBetween(
+      scene_state,
+      PointLink(Marker(marker1_index)),
+      PointLink(Marker(marker2_index))
+    );
+
+  SolveGraph graph = makeSolveGraph({{body_index, {}}}, scene_state);
+  assert(graph.variable_errors[0] == vector<DistanceErrorIndex>({error_index}));
+}
+
+
+static void testSolveComponents()
+{
+  SolveGraph graph;
+  graph.variable_errors = {{0}, {}, {1}, {0, 2}, {2}, {1}};
+  vector<SolveComponent> components = solveComponents(graph, 4);
+  using Indices = vector<size_t>;
+  using Errors = vector<DistanceErrorIndex>;
+  assert(components.size() == 2);
+  assert(components[0].variable_indices == Indices({0, 3, 4}));
+  assert(components[0].distance_error_indices == Errors({0, 2}));
+  assert(components[1].variable_indices == Indices({2, 5}));
+  assert(components[1].distance_error_indices == Errors({1}));
+}
+
+
+static void testBodiesNearErrors()
+{
+  // A chain of bodies, each joined to the next by a distance error.
+  SceneState scene_state;
+  vector<BodyIndex> body_indices;
+  vector<DistanceErrorIndex> error_indices;
+
+  for (int i = 0; i != 4; ++i) {
+    body_indices.push_back(scene_state.createBody());
+  }
+
+  for (int i = 0; i != 3; ++i) {
+    MarkerIndex marker1_index = scene_state.createMarker(body_indices[i]);
+    MarkerIndex marker2_index = scene_state.createMarker(body_indices[i + 1]);
+
+    error_indices.push_back(
+      createDistanceErrorBetween(
+        scene_state,
+        PointLink(Marker(marker1_index)),
+        PointLink(Marker(marker2_index))
+      )
+    );
+  }
+
+  using Errors = vector<DistanceErrorIndex>;
+
+  assert(
+    bodyDistanceErrors(scene_state, body_indices[1]) ==
+    Errors({error_indices[0], error_indices[1]})
+  );
+
+  Errors start_errors = bodyDistanceErrors(scene_state, body_indices[0]);
+  using Bodies = vector<bool>;
+
+  assert(
+    bodiesNearErrors(scene_state, start_errors, 0) ==
+    Bodies({false, false, false, false})
+  );
+
+  assert(
+    bodiesNearErrors(scene_state, start_errors, 1) ==
+    Bodies({true, true, false, false})
+  );
+
+  assert(
+    bodiesNearErrors(scene_state, start_errors, 2) ==
+    Bodies({true, true, true, false})
+  );
+
+  assert(
+    bodiesNearErrors(scene_state, start_errors, 5) ==
+    Bodies({true, true, true, true})
+  );
+}
+
+
+int main()
+{
+  testVariableErrors();
+  testErrorWithinOneBody();
+  testSolveComponents();
+  testBodiesNearErrors();
+}
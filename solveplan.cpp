@@ -0,0 +1,798 @@
+#include "solveplan.hpp"
+
+#include <algorithm>
+#include "indicesof.hpp"
+#include "solveflags.hpp"
+#include "sceneerror.hpp"
+#include "rotationvector.hpp"
+
+using Vector3f = Eigen::Vector3f;
+
+
+static void addBodyValues(vector<float> &values, const TransformState &t)
+{
+  values.push_back(t.translation.x);
+  values.push_back(t.translation.y);
+  values.push_back(t.translation.z);
+  values.push_back(t.rotation.x);
+  values.push_back(t.rotation.y);
+  values.push_back(t.rotation.z);
+  values.push_back(t.scale);
+}
+
+
+static void addXYZValues(vector<float> &values, const SceneState::XYZ &xyz)
+{
+  values.push_back(xyz.x);
+  values.push_back(xyz.y);
+  values.push_back(xyz.z);
+}
+
+
+static void
+  addBodySlots(
+    SolvePlan &plan,
+    BodyIndex body_index,
+    int parent_slot,
+    const SceneState &scene_state,
+    const vector<vector<BodyIndex>> &children,
+    vector<int> &body_slots
+  )
+{
+  int slot = plan.body_parent_slots.size();
+  body_slots[body_index] = slot;
+  plan.body_parent_slots.push_back(parent_slot);
+  plan.body_subtree_ends.push_back(slot + 1);
+  addBodyValues(plan.values, scene_state.body(body_index).transform);
+
+  for (BodyIndex child_index : children[body_index]) {
+    addBodySlots(
+      plan, child_index, slot, scene_state, children, body_slots
+    );
+  }
+
+  plan.body_subtree_ends[slot] = plan.body_parent_slots.size();
+}
+
+
+static void
+  addVariable(
+    SolvePlan &plan,
+    bool solve_flag,
+    int value_index,
+    float scale,
+    int body_slot,
+    bool changes_transforms
+  )
+{
+  if (!solve_flag) {
+    return;
+  }
+
+  plan.variable_value_indices.push_back(value_index);
+  plan.variable_inv_scales.push_back(1/scale);
+  plan.variable_body_slots.push_back(body_slot);
+  plan.variable_changes_transforms.push_back(changes_transforms);
+}
+
+
+// The variables are added in the same order as solveScene() uses.
+static void
+  addBodyVariables(
+    SolvePlan &plan,
+    const SceneState::Body &body_state,
+    int body_slot,
+    const vector<int> &mesh_slots
+  )
+{
+  struct Visitor {
+    SolvePlan &plan;
+    const SceneState::TransformSolveFlags &solve_flags;
+    int body_slot;
+
+    int valueIndex(int offset) const
+    {
+      return body_slot*SolvePlan::n_body_values + offset;
+    }
+
+    void visitTranslationComponent(XYZComponent c) const
+    {
+      addVariable(
+        plan, solve_flags.translation.component(c), valueIndex(int(c)),
+        /*scale*/1, body_slot, /*changes_transforms*/true
+      );
+    }
+
+    void visitRotationComponent(XYZComponent c) const
+    {
+      addVariable(
+        plan, solve_flags.rotation.component(c), valueIndex(3 + int(c)),
+        /*scale*/M_PI/180, body_slot, /*changes_transforms*/true
+      );
+    }
+
+    void visitScale() const
+    {
+      addVariable(
+        plan, solve_flags.scale, valueIndex(6), /*scale*/1, body_slot,
+        /*changes_transforms*/true
+      );
+    }
+  };
+
+  forEachSolvableTransformElement(
+    Visitor{plan, body_state.solve_flags, body_slot}
+  );
+
+  for (auto mesh_index : indicesOf(body_state.meshes)) {
+    const SceneState::Mesh &mesh_state = body_state.meshes[mesh_index];
+    int first_value = plan.first_mesh_value + mesh_slots[mesh_index]*3;
+
+    forEachXYZComponent(
+      [&](XYZComponent c){
+        addVariable(
+          plan, mesh_state.scale_solve_flags.component(c),
+          first_value + int(c), /*scale*/1, body_slot,
+          /*changes_transforms*/false
+        );
+      }
+    );
+  }
+}
+
+
+static Vector3f vector3f(const SceneState::XYZ &xyz)
+{
+  return {xyz.x, xyz.y, xyz.z};
+}
+
+
+namespace {
+struct PlanPoint {
+  int body_slot = 0;
+  int mesh_slot = 0;
+  Vector3f offset = Vector3f::Zero();
+  Vector3f factor = Vector3f::Zero();
+};
+}
+
+
+static PlanPoint
+  planPoint(
+    const PointLink &point,
+    const SceneState &scene_state,
+    const vector<int> &body_slots,
+    const vector<vector<int>> &mesh_slots
+  )
+{
+  PlanPoint result;
+
+  if (point.maybe_marker) {
+    const SceneState::Marker &marker =
+      scene_state.marker(point.maybe_marker->index);
+
+    Optional<BodyIndex> maybe_body_index = marker.maybe_body_index;
+
+    if (maybe_body_index) {
+      result.body_slot = body_slots[*maybe_body_index];
+    }
+
+    result.factor = vector3f(marker.position);
+  }
+  else if (point.maybe_body_mesh_position) {
+    BodyMeshPosition body_mesh_position = *point.maybe_body_mesh_position;
+    BodyIndex body_index = body_mesh_position.array.body_mesh.body.index;
+    MeshIndex mesh_index = body_mesh_position.array.body_mesh.index;
+
+    const SceneState::Mesh &mesh_state =
+      scene_state.body(body_index).meshes[mesh_index];
+
+    result.body_slot = body_slots[body_index];
+    result.mesh_slot = mesh_slots[body_index][mesh_index];
+    result.offset = vector3f(mesh_state.center);
+
+    result.factor =
+      vector3f(mesh_state.shape.positions[body_mesh_position.index]);
+  }
+  else {
+    assert(false); // not implemented
+  }
+
+  return result;
+}
+
+
+// Puts the points in the plan grouped by body slot and returns where each
+// one went.
+static vector<int>
+  addPoints(SolvePlan &plan, const vector<PlanPoint> &points, int n_slots)
+{
+  vector<int> &begins = plan.body_point_begins;
+  begins.assign(n_slots + 1, 0);
+
+  for (const PlanPoint &point : points) {
+    ++begins[point.body_slot + 1];
+  }
+
+  for (int slot = 0; slot != n_slots; ++slot) {
+    begins[slot + 1] += begins[slot];
+  }
+
+  size_t n_points = points.size();
+  vector<int> next_rows(begins.begin(), begins.end() - 1);
+  vector<int> rows(n_points);
+  plan.point_body_slots.resize(n_points);
+  plan.point_mesh_slots.resize(n_points);
+  plan.point_offsets.resize(n_points, 3);
+  plan.point_factors.resize(n_points, 3);
+
+  for (auto point_index : indicesOf(points)) {
+    const PlanPoint &point = points[point_index];
+    int row = next_rows[point.body_slot]++;
+    rows[point_index] = row;
+    plan.point_body_slots[row] = point.body_slot;
+    plan.point_mesh_slots[row] = point.mesh_slot;
+    plan.point_offsets.row(row) = point.offset.transpose().array();
+    plan.point_factors.row(row) = point.factor.transpose().array();
+  }
+
+  plan.local_points.resize(n_points, 3);
+  plan.global_points.resize(n_points, 3);
+  return rows;
+}
+
+
+SolvePlan makeSolvePlan(const SceneState &scene_state)
+{
+  SolvePlan plan;
+  size_t n_bodies = scene_state.bodies().size();
+  vector<vector<BodyIndex>> children(n_bodies);
+  vector<BodyIndex> root_indices;
+
+  for (auto body_index : indicesOf(scene_state.bodies())) {
+    Optional<BodyIndex> maybe_parent_index =
+      scene_state.body(body_index).maybe_parent_index;
+
+    if (maybe_parent_index) {
+      children[*maybe_parent_index].push_back(body_index);
+    }
+    else {
+      root_indices.push_back(body_index);
+    }
+  }
+
+  plan.body_parent_slots.push_back(0);
+  plan.body_subtree_ends.push_back(n_bodies + 1);
+  addBodyValues(plan.values, TransformState());
+  vector<int> body_slots(n_bodies);
+
+  for (BodyIndex body_index : root_indices) {
+    addBodySlots(
+      plan, body_index, /*parent_slot*/0, scene_state, children, body_slots
+    );
+  }
+
+  plan.body_global_transforms.assign(n_bodies + 1, Transform::Identity());
+  plan.body_rotations.resize(n_bodies + 1);
+  plan.first_mesh_value = plan.values.size();
+  addXYZValues(plan.values, {1,1,1});
+  vector<vector<int>> mesh_slots(n_bodies);
+  int n_mesh_slots = 1;
+
+  for (auto body_index : indicesOf(scene_state.bodies())) {
+    for (auto &mesh_state : scene_state.body(body_index).meshes) {
+      mesh_slots[body_index].push_back(n_mesh_slots++);
+      addXYZValues(plan.values, mesh_state.scale);
+    }
+  }
+
+  for (auto body_index : indicesOf(scene_state.bodies())) {
+    addBodyVariables(
+      plan, scene_state.body(body_index), body_slots[body_index],
+      mesh_slots[body_index]
+    );
+  }
+
+  size_t n_errors = scene_state.distance_errors.size();
+  vector<PlanPoint> points;
+  plan.error_desired_distances.resize(n_errors);
+  plan.error_weights.resize(n_errors);
+  plan.error_n_residuals.resize(n_errors);
+
+  for (auto index : indicesOf(scene_state.distance_errors)) {
+    const SceneState::DistanceError &distance_error =
+      scene_state.distance_errors[index];
+
+    int n_residuals = distanceErrorResidualCount(distance_error);
+
+    if (n_residuals != 0) {
+      points.push_back(
+        planPoint(
+          *distance_error.optional_start, scene_state, body_slots, mesh_slots
+        )
+      );
+
+      points.push_back(
+        planPoint(
+          *distance_error.optional_end, scene_state, body_slots, mesh_slots
+        )
+      );
+
+      plan.error_weights[index] = distance_error.weight;
+    }
+    else {
+      points.emplace_back();
+      points.emplace_back();
+      plan.error_weights[index] = 0;
+    }
+
+    plan.error_desired_distances[index] = distance_error.desired_distance;
+    plan.error_n_residuals[index] = n_residuals;
+  }
+
+  vector<int> point_rows = addPoints(plan, points, n_bodies + 1);
+  plan.error_start_points.resize(n_errors);
+  plan.error_end_points.resize(n_errors);
+
+  for (size_t index = 0; index != n_errors; ++index) {
+    plan.error_start_points[index] = point_rows[index*2];
+    plan.error_end_points[index] = point_rows[index*2 + 1];
+  }
+
+  plan.error_weight_roots = plan.error_weights.sqrt();
+  updatePlanPoints(plan);
+  return plan;
+}
+
+
+bool setPlanVariable(SolvePlan &plan, size_t variable_index, float variable)
+{
+  float &value = plan.values[plan.variable_value_indices[variable_index]];
+  float new_value = variable*plan.variable_inv_scales[variable_index];
+
+  if (value == new_value) {
+    return false;
+  }
+
+  value = new_value;
+  return true;
+}
+
+
+void setPlanVariables(SolvePlan &plan, const vector<float> &variables)
+{
+  assert(variables.size() == plan.variable_value_indices.size());
+
+  for (auto variable_index : indicesOf(variables)) {
+    setPlanVariable(plan, variable_index, variables[variable_index]);
+  }
+}
+
+
+static Transform
+  localTransform(const float *values, CachedRotation &cached_rotation)
+{
+  const Eigen::Matrix3f &rotation =
+    cached_rotation.update(Vec3(values[3], values[4], values[5]));
+
+  Transform result;
+  result.linear() = rotation*values[6];
+  result.translation() = Eigen::Vector3f(values[0], values[1], values[2]);
+  return result;
+}
+
+
+static void updateSlotTransform(SolvePlan &plan, int slot)
+{
+  Transform local =
+    localTransform(
+      &plan.values[slot*SolvePlan::n_body_values], plan.body_rotations[slot]
+    );
+
+  int parent_slot = plan.body_parent_slots[slot];
+
+  if (parent_slot != 0) {
+    plan.body_global_transforms[slot] =
+      plan.body_global_transforms[parent_slot]*local;
+  }
+  else {
+    plan.body_global_transforms[slot] = local;
+  }
+}
+
+
+static Vector3f meshScale(const SolvePlan &plan, int mesh_slot)
+{
+  const float *scale = &plan.values[plan.first_mesh_value + mesh_slot*3];
+  return {scale[0], scale[1], scale[2]};
+}
+
+
+// The points of a range of body slots are contiguous, and the points of
+// each body are transformed a whole column at a time, so Eigen can use
+// SIMD instructions for them.
+static void updateSlotPoints(SolvePlan &plan, int first_slot, int end_slot)
+{
+  int first_row = plan.body_point_begins[first_slot];
+  int n_rows = plan.body_point_begins[end_slot] - first_row;
+  auto locals = plan.local_points.middleRows(first_row, n_rows);
+
+  for (int i = 0; i != n_rows; ++i) {
+    int mesh_slot = plan.point_mesh_slots[first_row + i];
+    locals.row(i) = meshScale(plan, mesh_slot).transpose().array();
+  }
+
+  locals =
+    plan.point_offsets.middleRows(first_row, n_rows) +
+    plan.point_factors.middleRows(first_row, n_rows)*locals;
+
+  for (int slot = first_slot; slot != end_slot; ++slot) {
+    int begin = plan.body_point_begins[slot];
+    int n = plan.body_point_begins[slot + 1] - begin;
+
+    if (n == 0) {
+      continue;
+    }
+
+    auto globals = plan.global_points.middleRows(begin, n);
+
+    if (slot == 0) {
+      globals = plan.local_points.middleRows(begin, n);
+      continue;
+    }
+
+    const Transform &transform = plan.body_global_transforms[slot];
+    auto linear = transform.linear();
+    auto translation = transform.translation();
+    auto xs = plan.local_points.col(0).segment(begin, n);
+    auto ys = plan.local_points.col(1).segment(begin, n);
+    auto zs = plan.local_points.col(2).segment(begin, n);
+
+    for (int i = 0; i != 3; ++i) {
+      globals.col(i) =
+        linear(i, 0)*xs + linear(i, 1)*ys + linear(i, 2)*zs + translation[i];
+    }
+  }
+}
+
+
+void updatePlanPoints(SolvePlan &plan)
+{
+  int end_slot = plan.body_subtree_ends[0];
+
+  for (int slot = 1; slot != end_slot; ++slot) {
+    updateSlotTransform(plan, slot);
+  }
+
+  updateSlotPoints(plan, 0, end_slot);
+}
+
+
+void updatePlanPointsForVariable(SolvePlan &plan, size_t variable_index)
+{
+  int body_slot = plan.variable_body_slots[variable_index];
+
+  if (!plan.variable_changes_transforms[variable_index]) {
+    updateSlotPoints(plan, body_slot, body_slot + 1);
+    return;
+  }
+
+  int end_slot = plan.body_subtree_ends[body_slot];
+
+  for (int slot = body_slot; slot != end_slot; ++slot) {
+    updateSlotTransform(plan, slot);
+  }
+
+  updateSlotPoints(plan, body_slot, end_slot);
+}
+
+
+static const int pack_size = 8;
+using Pack = Eigen::Array<float, pack_size, 1>;
+
+
+// The values for up to pack_size distance errors, where the unused entries
+// have zero weight.
+namespace {
+struct ErrorPack {
+  Pack dxs;
+  Pack dys;
+  Pack dzs;
+  Pack desired_distances;
+  Pack weights;
+  Pack weight_roots;
+
+  template <typename ErrorIndex>
+  ErrorPack(const SolvePlan &plan, int n, const ErrorIndex &error_index)
+  {
+    const Eigen::ArrayX3f &points = plan.global_points;
+
+    if (n != pack_size) {
+      dxs.setZero();
+      dys.setZero();
+      dzs.setZero();
+      desired_distances.setZero();
+      weights.setZero();
+      weight_roots.setZero();
+    }
+
+    for (int i = 0; i != n; ++i) {
+      DistanceErrorIndex index = error_index(i);
+      int start = plan.error_start_points[index];
+      int end = plan.error_end_points[index];
+      dxs[i] = points(start, 0) - points(end, 0);
+      dys[i] = points(start, 1) - points(end, 1);
+      dzs[i] = points(start, 2) - points(end, 2);
+      desired_distances[i] = plan.error_desired_distances[index];
+      weights[i] = plan.error_weights[index];
+      weight_roots[i] = plan.error_weight_roots[index];
+    }
+  }
+
+  Pack distances() const
+  {
+    return (dxs.square() + dys.square() + dzs.square()).sqrt();
+  }
+
+  Pack errors() const
+  {
+    return (distances() - desired_distances).square()*weights;
+  }
+};
+}
+
+
+// Calls f(pack, n_in_pack, error_index) for each pack of the n errors,
+// where error_index(i) gives the index of the i'th error in the pack.
+template <typename ErrorIndex, typename F>
+static void
+  forEachErrorPack(
+    const SolvePlan &plan,
+    size_t n,
+    const ErrorIndex &error_index,
+    const F &f
+  )
+{
+  for (size_t first = 0; first < n; first += pack_size) {
+    int n_in_pack = std::min<size_t>(n - first, pack_size);
+    auto pack_error_index = [&](int i){ return error_index(first + i); };
+    ErrorPack pack(plan, n_in_pack, pack_error_index);
+    f(pack, n_in_pack, pack_error_index);
+  }
+}
+
+
+void
+  evaluatePlanErrors(
+    const SolvePlan &plan,
+    const vector<DistanceErrorIndex> &indices,
+    Eigen::ArrayXf &errors
+  )
+{
+  forEachErrorPack(
+    plan,
+    indices.size(),
+    [&](size_t i){ return indices[i]; },
+    [&](const ErrorPack &pack, int n, const auto &error_index){
+      Pack pack_errors = pack.errors();
+
+      for (int i = 0; i != n; ++i) {
+        errors[error_index(i)] = pack_errors[i];
+      }
+    }
+  );
+}
+
+
+void evaluatePlanErrors(const SolvePlan &plan, Eigen::ArrayXf &errors)
+{
+  size_t n_errors = plan.error_n_residuals.size();
+  errors.resize(n_errors);
+
+  forEachErrorPack(
+    plan,
+    n_errors,
+    [](size_t i){ return i; },
+    [&](const ErrorPack &pack, int n, const auto &error_index){
+      errors.segment(error_index(0), n) = pack.errors().head(n);
+    }
+  );
+}
+
+
+static Eigen::Index nResiduals(const SolvePlan &plan)
+{
+  Eigen::Index n_residuals = 0;
+
+  for (int n_error_residuals : plan.error_n_residuals) {
+    n_residuals += n_error_residuals;
+  }
+
+  return n_residuals;
+}
+
+
+void evaluatePlanResiduals(const SolvePlan &plan, Eigen::VectorXf &residuals)
+{
+  residuals.resize(nResiduals(plan));
+  Eigen::Index row_index = 0;
+
+  forEachErrorPack(
+    plan,
+    plan.error_n_residuals.size(),
+    [](size_t i){ return i; },
+    [&](const ErrorPack &pack, int n, const auto &error_index){
+      Pack xs = pack.dxs*pack.weight_roots;
+      Pack ys = pack.dys*pack.weight_roots;
+      Pack zs = pack.dzs*pack.weight_roots;
+
+      Pack distance_residuals =
+        (pack.distances() - pack.desired_distances)*pack.weight_roots;
+
+      for (int i = 0; i != n; ++i) {
+        int n_error_residuals = plan.error_n_residuals[error_index(i)];
+
+        if (n_error_residuals == 3) {
+          residuals[row_index] = xs[i];
+          residuals[row_index + 1] = ys[i];
+          residuals[row_index + 2] = zs[i];
+        }
+        else if (n_error_residuals == 1) {
+          residuals[row_index] = distance_residuals[i];
+        }
+
+        row_index += n_error_residuals;
+      }
+    }
+  );
+}
+
+
+// The rotation value that a variable sets, from 0 to 2, if it sets one.
+static Optional<int>
+  maybeRotationComponent(const SolvePlan &plan, size_t variable_index)
+{
+  int value_index = plan.variable_value_indices[variable_index];
+
+  if (value_index >= plan.first_mesh_value) {
+    return {};
+  }
+
+  int body_value_index = value_index % SolvePlan::n_body_values;
+
+  if (body_value_index < 3 || body_value_index >= 6) {
+    return {};
+  }
+
+  return body_value_index - 3;
+}
+
+
+bool isSerialRotationChain(const SolvePlan &plan)
+{
+  vector<int> slots;
+
+  for (auto variable_index : indicesOf(plan.variable_value_indices)) {
+    if (!maybeRotationComponent(plan, variable_index)) {
+      return false;
+    }
+
+    slots.push_back(plan.variable_body_slots[variable_index]);
+  }
+
+  if (slots.empty()) {
+    return false;
+  }
+
+  std::sort(slots.begin(), slots.end());
+  slots.erase(std::unique(slots.begin(), slots.end()), slots.end());
+
+  for (size_t i = 1; i < slots.size(); ++i) {
+    if (slots[i] >= plan.body_subtree_ends[slots[i - 1]]) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+// How a rotation variable moves the points on its body and the body's
+// descendants.  If a is a point relative to the body's origin, in the
+// parent's coordinates, rotating by the variable moves it at the rate
+// -cross(a, axis), where axis is a column of rotationVectorJacobian().
+namespace {
+struct RotationDerivative {
+  int body_slot;
+  Vector3f origin;
+  Eigen::Matrix3f parent_linear;
+  Eigen::Matrix3f parent_linear_inverse;
+  Vector3f axis;
+
+  RotationDerivative(const SolvePlan &plan, size_t variable_index)
+  : body_slot(plan.variable_body_slots[variable_index]),
+    origin(plan.body_global_transforms[body_slot].translation()),
+    parent_linear(Eigen::Matrix3f::Identity())
+  {
+    int parent_slot = plan.body_parent_slots[body_slot];
+
+    if (parent_slot != 0) {
+      parent_linear = plan.body_global_transforms[parent_slot].linear();
+    }
+
+    parent_linear_inverse = parent_linear.inverse();
+    const float *values = &plan.values[body_slot*SolvePlan::n_body_values];
+    Vec3 rotation_rad = Vec3(values[3], values[4], values[5])*(M_PI/180);
+    int component = *maybeRotationComponent(plan, variable_index);
+    axis = rotationVectorJacobian(rotation_rad).col(component);
+  }
+
+  Vector3f pointDerivative(const SolvePlan &plan, int point) const
+  {
+    int point_slot = plan.point_body_slots[point];
+
+    if (point_slot < body_slot) {
+      return Vector3f::Zero();
+    }
+
+    if (point_slot >= plan.body_subtree_ends[body_slot]) {
+      return Vector3f::Zero();
+    }
+
+    Vector3f global = plan.global_points.row(point).transpose();
+    Vector3f a = parent_linear_inverse*(global - origin);
+    return -(parent_linear*a.cross(axis));
+  }
+};
+}
+
+
+void
+  evaluatePlanRotationJacobian(
+    const SolvePlan &plan,
+    Eigen::MatrixXf &jacobian
+  )
+{
+  size_t n_variables = plan.variable_value_indices.size();
+  jacobian.setZero(nResiduals(plan), n_variables);
+
+  for (auto variable_index : indicesOf(plan.variable_value_indices)) {
+    RotationDerivative derivative(plan, variable_index);
+    Eigen::Index row_index = 0;
+
+    for (auto error_index : indicesOf(plan.error_n_residuals)) {
+      int n_residuals = plan.error_n_residuals[error_index];
+
+      if (n_residuals == 0) {
+        continue;
+      }
+
+      int start = plan.error_start_points[error_index];
+      int end = plan.error_end_points[error_index];
+      float weight_root = plan.error_weight_roots[error_index];
+
+      Vector3f point_derivative =
+        derivative.pointDerivative(plan, start) -
+        derivative.pointDerivative(plan, end);
+
+      if (n_residuals == 3) {
+        jacobian.block<3,1>(row_index, variable_index) =
+          weight_root*point_derivative;
+      }
+      else {
+        Vector3f delta =
+          (plan.global_points.row(start) - plan.global_points.row(end))
+          .transpose();
+
+        float distance = delta.norm();
+
+        if (distance != 0) {
+          jacobian(row_index, variable_index) =
+            weight_root*delta.dot(point_derivative)/distance;
+        }
+      }
+
+      row_index += n_residuals;
+    }
+  }
+}
@@ -0,0 +1,120 @@
+#ifndef SOLVEPLAN_HPP_
+#define SOLVEPLAN_HPP_
+
+#include "transform.hpp"
+#include "rotationvector.hpp"
+#include "scenestate.hpp"
+
+
+// A flattened copy of the parts of a scene that are needed for evaluating
+// the distance errors while solving.  Everything is kept in contiguous
+// arrays indexed by slot, so that evaluating the errors for new variable
+// values doesn't need to go through the scene state at all.
+struct SolvePlan {
+  // The translation, the rotation in degrees, and the scale.
+  static const int n_body_values = 7;
+
+  // Body slot 0 is the scene itself, which always has an identity
+  // transform.  The other bodies follow in depth-first order, so the
+  // descendants of the body in slot s are in the slots after s, up to
+  // body_subtree_ends[s].
+  vector<int> body_parent_slots;
+  vector<int> body_subtree_ends;
+  vector<Transform, Eigen::aligned_allocator<Transform>> body_global_transforms;
+
+  // The rotation matrix of each body slot, which is only remade when the
+  // slot's rotation values change, since changing a translation or scale
+  // variable leaves it the same.
+  vector<CachedRotation> body_rotations;
+
+  // The values of each body slot, followed by the three scale values of
+  // each mesh slot.  Mesh slot 0 has a scale of one and is used for markers.
+  vector<float> values;
+  int first_mesh_value = 0;
+
+  // The points are grouped by body slot, so the points of the body in
+  // slot s are the rows from body_point_begins[s] up to
+  // body_point_begins[s + 1], and can be transformed together.  Each
+  // column of the point arrays has one coordinate of all the points, so
+  // that the batches vectorize.  A point's local position is the offset
+  // plus the factor scaled by the scale of its mesh.
+  vector<int> body_point_begins;
+  vector<int> point_body_slots;
+  vector<int> point_mesh_slots;
+  Eigen::ArrayX3f point_offsets;
+  Eigen::ArrayX3f point_factors;
+
+  // One entry for each distance error in the scene.  Distance errors
+  // without both points have no residuals, and have a weight of zero so
+  // that they always have zero error.
+  vector<int> error_start_points;
+  vector<int> error_end_points;
+  Eigen::ArrayXf error_desired_distances;
+  Eigen::ArrayXf error_weights;
+  Eigen::ArrayXf error_weight_roots;
+  vector<int> error_n_residuals;
+
+  // The local and global position of each point, which are updated
+  // along with the transforms.
+  Eigen::ArrayX3f local_points;
+  Eigen::ArrayX3f global_points;
+
+  // For each solve variable, in the order used by solveScene(), the value
+  // that it sets, and what the variable is multiplied by to get the value.
+  // The body slot is the one whose transform or mesh scale the variable
+  // changes.
+  vector<int> variable_value_indices;
+  vector<float> variable_inv_scales;
+  vector<int> variable_body_slots;
+  vector<bool> variable_changes_transforms;
+};
+
+
+extern SolvePlan makeSolvePlan(const SceneState &);
+
+// Returns whether the value changed.  Nothing that depends on the value is
+// updated.
+extern bool
+  setPlanVariable(SolvePlan &, size_t variable_index, float variable);
+
+extern void setPlanVariables(SolvePlan &, const vector<float> &variables);
+
+// Updates the global transforms and points from the values.
+extern void updatePlanPoints(SolvePlan &);
+
+// Only updates the global transforms and points that depend on the
+// variable.
+extern void updatePlanPointsForVariable(SolvePlan &, size_t variable_index);
+
+// The errors are evaluated in packs of several errors at a time, which
+// Eigen vectorizes with whichever SIMD instructions the compiler has been
+// told it can use, or evaluates with scalar code otherwise.  The global
+// points must be up to date.
+
+// Sets errors[i] for each distance error index i.
+extern void
+  evaluatePlanErrors(
+    const SolvePlan &,
+    const vector<DistanceErrorIndex> &,
+    Eigen::ArrayXf &errors
+  );
+
+extern void evaluatePlanErrors(const SolvePlan &, Eigen::ArrayXf &errors);
+
+// The residuals are the same as distanceErrorResidualCount() and
+// evaluateDistanceErrorResiduals() give, for all the distance errors in
+// order.
+extern void evaluatePlanResiduals(const SolvePlan &, Eigen::VectorXf &);
+
+// Whether every variable is a rotation component, and each body that the
+// variables rotate is a descendant of the others that come before it in
+// depth-first order, like the joints of a serial chain.
+extern bool isSerialRotationChain(const SolvePlan &);
+
+// The derivatives of the residuals from evaluatePlanResiduals() with
+// respect to each variable, when every variable is a rotation component.
+// The global points must be up to date.
+extern void
+  evaluatePlanRotationJacobian(const SolvePlan &, Eigen::MatrixXf &jacobian);
+
+#endif /* SOLVEPLAN_HPP_ */
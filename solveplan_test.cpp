@@ -0,0 +1,275 @@
+#include "solveplan.hpp"
+
+#include <iostream>
+#include "sceneerror.hpp"
+#include "indicesof.hpp"
+#include "randomengine.hpp"
+#include "randomvec3.hpp"
+#include "assertnearfloat.hpp"
+#include "solveflags.hpp"
+
+using std::cerr;
+
+
+static SceneState::XYZ randomXYZ(RandomEngine &engine)
+{
+  Vec3 v = randomVec3(engine);
+  return {v.x, v.y, v.z};
+}
+
+
+static void
+  addDistanceError(
+    SceneState &scene_state,
+    Optional<PointLink> maybe_start,
+    Optional<PointLink> maybe_end,
+    float desired_distance
+  )
+{
+  DistanceErrorIndex index = scene_state.createDistanceError();
+  SceneState::DistanceError &distance_error =
+    scene_state.distance_errors[index];
+
+  distance_error.setStart(maybe_start);
+  distance_error.setEnd(maybe_end);
+  distance_error.desired_distance = desired_distance;
+  distance_error.weight = 2;
+}
+
+
+// A hierarchy where the bodies aren't in depth-first order, with markers
+// and mesh positions on different bodies.
+static SceneState makeScene(RandomEngine &engine)
+{
+  SceneState scene_state;
+  BodyIndex root_index = scene_state.createBody();
+  BodyIndex other_root_index = scene_state.createBody();
+  BodyIndex child_index = scene_state.createBody(root_index);
+  BodyIndex grandchild_index = scene_state.createBody(child_index);
+  SceneState::MeshShape mesh_shape;
+  mesh_shape.positions.push_back(randomXYZ(engine));
+  mesh_shape.positions.push_back(randomXYZ(engine));
+
+  MeshIndex mesh_index =
+    scene_state.body(grandchild_index).createMesh(mesh_shape);
+
+  for (auto body_index : indicesOf(scene_state.bodies())) {
+    SceneState::Body &body_state = scene_state.body(body_index);
+    body_state.transform.translation = randomXYZ(engine);
+    body_state.transform.rotation = randomXYZ(engine);
+    body_state.transform.scale = 1.5;
+    setAll(body_state.solve_flags, true);
+    body_state.solve_flags.scale = true;
+  }
+
+  SceneState::Mesh &mesh_state =
+    scene_state.body(grandchild_index).meshes[mesh_index];
+
+  mesh_state.scale = {1, 2, 3};
+  mesh_state.center = randomXYZ(engine);
+  mesh_state.scale_solve_flags.y = true;
+
+  MarkerIndex global_marker_index = scene_state.createMarker();
+  MarkerIndex child_marker_index = scene_state.createMarker(child_index);
+  MarkerIndex other_marker_index = scene_state.createMarker(other_root_index);
+
+  for (auto marker_index : indicesOf(scene_state.markers())) {
+    scene_state.marker(marker_index).position = randomXYZ(engine);
+  }
+
+  BodyMeshPosition mesh_position =
+    Body(grandchild_index).mesh(mesh_index).position(1);
+
+  addDistanceError(
+    scene_state, PointLink(Marker(child_marker_index)),
+    PointLink(Marker(global_marker_index)), /*desired_distance*/0
+  );
+
+  addDistanceError(
+    scene_state, PointLink(mesh_position),
+    PointLink(Marker(other_marker_index)), /*desired_distance*/1
+  );
+
+  addDistanceError(
+    scene_state, PointLink(Marker(child_marker_index)), {},
+    /*desired_distance*/0
+  );
+
+  addDistanceError(
+    scene_state, PointLink(mesh_position),
+    PointLink(Marker(global_marker_index)), /*desired_distance*/0
+  );
+
+  return scene_state;
+}
+
+
+static void
+  assertSameErrors(const SolvePlan &plan, const SceneState &scene_state)
+{
+  SceneState updated_state = scene_state;
+  updateErrorsInState(updated_state);
+  GlobalTransformCache cache(updated_state);
+  Eigen::VectorXf residuals;
+  evaluatePlanResiduals(plan, residuals);
+  Eigen::ArrayXf errors;
+  evaluatePlanErrors(plan, errors);
+  assert(errors.size() == Eigen::Index(updated_state.distance_errors.size()));
+
+  // Evaluating some of the errors gives the same values.
+  Eigen::ArrayXf some_errors = Eigen::ArrayXf::Zero(errors.size());
+  vector<DistanceErrorIndex> some_indices = {3, 1};
+  evaluatePlanErrors(plan, some_indices, some_errors);
+  assert(some_errors[0] == 0);
+  assert(some_errors[1] == errors[1]);
+  assert(some_errors[3] == errors[3]);
+  Eigen::Index row_index = 0;
+
+  for (auto index : indicesOf(updated_state.distance_errors)) {
+    const SceneState::DistanceError &distance_error =
+      updated_state.distance_errors[index];
+
+    assertNear(errors[index], distance_error.error, 1e-4);
+    int n_residuals = distanceErrorResidualCount(distance_error);
+    Eigen::Vector3f expected_residuals;
+
+    evaluateDistanceErrorResiduals(
+      distance_error, updated_state, cache, expected_residuals
+    );
+
+    for (int i = 0; i != n_residuals; ++i) {
+      assertNear(residuals[row_index + i], expected_residuals[i], 1e-4);
+    }
+
+    row_index += n_residuals;
+  }
+
+  assert(row_index == residuals.size());
+}
+
+
+static void testMatchingTheSceneErrors()
+{
+  RandomEngine engine(/*seed*/1);
+  SceneState scene_state = makeScene(engine);
+  SolvePlan plan = makeSolvePlan(scene_state);
+  assert(plan.body_parent_slots.size() == scene_state.bodies().size() + 1);
+
+  // Four bodies with seven variables each, plus the mesh y scale.
+  assert(plan.variable_value_indices.size() == 4*7 + 1);
+  assertSameErrors(plan, scene_state);
+}
+
+
+static void testChangingVariables()
+{
+  RandomEngine engine(/*seed*/1);
+  SceneState scene_state = makeScene(engine);
+  SolvePlan plan = makeSolvePlan(scene_state);
+
+  // The first variable is the x translation of the root, which moves its
+  // descendants, and the last one is the mesh y scale.
+  float new_x = scene_state.body(0).transform.translation.x + 1;
+  scene_state.body(0).transform.translation.x = new_x;
+  assert(setPlanVariable(plan, 0, new_x));
+  assert(!setPlanVariable(plan, 0, new_x));
+  updatePlanPointsForVariable(plan, 0);
+  assertSameErrors(plan, scene_state);
+
+  size_t mesh_variable_index = plan.variable_value_indices.size() - 1;
+  assert(!plan.variable_changes_transforms[mesh_variable_index]);
+  scene_state.body(3).meshes[0].scale.y = 5;
+  setPlanVariable(plan, mesh_variable_index, 5);
+  updatePlanPointsForVariable(plan, mesh_variable_index);
+  assertSameErrors(plan, scene_state);
+
+  // Rotation variables are in radians.
+  float new_rotation = 30;
+  scene_state.body(1).transform.rotation.y = new_rotation;
+  vector<float> variables;
+
+  for (auto variable_index : indicesOf(plan.variable_value_indices)) {
+    float value = plan.values[plan.variable_value_indices[variable_index]];
+    variables.push_back(value/plan.variable_inv_scales[variable_index]);
+  }
+
+  // The second body has variables 7 to 13, and its y rotation is the fifth.
+  variables[7 + 4] = new_rotation*M_PI/180;
+  setPlanVariables(plan, variables);
+  updatePlanPoints(plan);
+  assertSameErrors(plan, scene_state);
+
+  // Moving the body afterwards keeps its new rotation.
+  scene_state.body(1).transform.translation.z += 1;
+  variables[7 + 2] += 1;
+  setPlanVariable(plan, 7 + 2, variables[7 + 2]);
+  updatePlanPointsForVariable(plan, 7 + 2);
+  assertSameErrors(plan, scene_state);
+}
+
+
+static void
+  evaluateResidualsWithVariable(
+    SolvePlan &plan,
+    size_t variable_index,
+    float variable,
+    Eigen::VectorXf &residuals
+  )
+{
+  setPlanVariable(plan, variable_index, variable);
+  updatePlanPoints(plan);
+  evaluatePlanResiduals(plan, residuals);
+}
+
+
+static void testRotationJacobian()
+{
+  RandomEngine engine(/*seed*/1);
+  SceneState scene_state = makeScene(engine);
+
+  // Only solving the rotations of the first root and its descendants
+  // makes a serial chain.
+  for (auto body_index : indicesOf(scene_state.bodies())) {
+    SceneState::Body &body_state = scene_state.body(body_index);
+    setAll(body_state.solve_flags.translation, false);
+    body_state.solve_flags.scale = false;
+    setAll(body_state.solve_flags.rotation, body_index != 1);
+  }
+
+  scene_state.body(3).meshes[0].scale_solve_flags.y = false;
+  SolvePlan plan = makeSolvePlan(scene_state);
+  assert(isSerialRotationChain(plan));
+  updatePlanPoints(plan);
+  Eigen::MatrixXf jacobian;
+  evaluatePlanRotationJacobian(plan, jacobian);
+  assert(jacobian.cols() == 3*3);
+
+  // Compare with central differences.
+  for (auto variable_index : indicesOf(plan.variable_value_indices)) {
+    int value_index = plan.variable_value_indices[variable_index];
+    float inv_scale = plan.variable_inv_scales[variable_index];
+    float variable = plan.values[value_index]/inv_scale;
+    float h = 1e-3;
+    Eigen::VectorXf before, after, unchanged;
+    evaluateResidualsWithVariable(plan, variable_index, variable - h, before);
+    evaluateResidualsWithVariable(plan, variable_index, variable + h, after);
+    evaluateResidualsWithVariable(plan, variable_index, variable, unchanged);
+    Eigen::VectorXf expected = (after - before)/(2*h);
+
+    for (Eigen::Index row = 0; row != jacobian.rows(); ++row) {
+      assertNear(jacobian(row, variable_index), expected[row], 1e-2);
+    }
+  }
+
+  // Also solving the rotation of the other root makes it a tree instead.
+  setAll(scene_state.body(1).solve_flags.rotation, true);
+  assert(!isSerialRotationChain(makeSolvePlan(scene_state)));
+}
+
+
+int main()
+{
+  testMatchingTheSceneErrors();
+  testChangingVariables();
+  testRotationJacobian();
+}
@@ -0,0 +1,384 @@
+// Measures how long solveScene() takes on generated scenes of various
+// shapes and sizes.  An optional argument limits the cases to those whose
+// name contains it.  This is most useful when built with optimization:
+//
+//   make clean && make OPTIMIZATION="-O3 -DNDEBUG" solver_benchmark
+
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+#include <string>
+#include <sstream>
+#include <functional>
+#include "scenesolver.hpp"
+#include "sceneerror.hpp"
+#include "globaltransform.hpp"
+#include "transformstate.hpp"
+#include "positionstate.hpp"
+#include "randomengine.hpp"
+#include "pointlink.hpp"
+#include "indicesof.hpp"
+#include "threadpool.hpp"
+
+using std::cout;
+using std::string;
+
+
+static float randomFloat(float low, float high, RandomEngine &engine)
+{
+  return std::uniform_real_distribution<float>(low, high)(engine);
+}
+
+
+static Point randomPoint(float range, RandomEngine &engine)
+{
+  return {
+    randomFloat(-range, range, engine),
+    randomFloat(-range, range, engine),
+    randomFloat(-range, range, engine)
+  };
+}
+
+
+static void
+  setRandomRotation(
+    SceneState::XYZ &rotation,
+    float range_deg,
+    RandomEngine &engine
+  )
+{
+  rotation.x = randomFloat(-range_deg, range_deg, engine);
+  rotation.y = randomFloat(-range_deg, range_deg, engine);
+  rotation.z = randomFloat(-range_deg, range_deg, engine);
+}
+
+
+static MarkerIndex
+  addMarker(
+    SceneState &scene_state,
+    const Point &position,
+    Optional<BodyIndex> maybe_body_index
+  )
+{
+  MarkerIndex marker_index = scene_state.createUnnamedMarker();
+  SceneState::Marker &marker_state = scene_state.marker(marker_index);
+  marker_state.position = makePositionStateFromPoint(position);
+  marker_state.maybe_body_index = maybe_body_index;
+  return marker_index;
+}
+
+
+static void
+  addDistanceError(
+    SceneState &scene_state,
+    MarkerIndex start_marker_index,
+    MarkerIndex end_marker_index
+  )
+{
+  DistanceErrorIndex index = scene_state.createDistanceError();
+  SceneState::DistanceError &distance_error = scene_state.distance_errors[index];
+  distance_error.setStart(Marker(start_marker_index));
+  distance_error.setEnd(Marker(end_marker_index));
+}
+
+
+// Adds a global marker where each of the given markers currently is, along
+// with a distance error that pulls the marker to it.
+static void
+  addTargetsFor(
+    SceneState &scene_state,
+    const vector<MarkerIndex> &marker_indices
+  )
+{
+  for (MarkerIndex marker_index : marker_indices) {
+    Point target = markerPredicted(scene_state, marker_index);
+    MarkerIndex target_index = addMarker(scene_state, target, {});
+    addDistanceError(scene_state, marker_index, target_index);
+  }
+}
+
+
+// Moves the solved values away from where they were when the targets were
+// made.
+static void
+  perturbSolvedValues(
+    SceneState &scene_state,
+    float translation_amount,
+    float rotation_amount_deg,
+    RandomEngine &engine
+  )
+{
+  for (auto body_index : indicesOf(scene_state.bodies())) {
+    SceneState::Body &body_state = scene_state.body(body_index);
+    const SceneState::TransformSolveFlags &flags = body_state.solve_flags;
+
+    forEachXYZComponent([&](XYZComponent c){
+      if (flags.translation.component(c)) {
+        body_state.transform.translation.component(c) +=
+          randomFloat(-translation_amount, translation_amount, engine);
+      }
+
+      if (flags.rotation.component(c)) {
+        body_state.transform.rotation.component(c) +=
+          randomFloat(-rotation_amount_deg, rotation_amount_deg, engine);
+      }
+    });
+  }
+}
+
+
+// A serial chain like robot_arm.scn, where only the rotations are solved.
+// The last n_errors bodies have a marker at their end that has a target.
+static SceneState makeChainScene(int n_bodies, int n_errors)
+{
+  RandomEngine engine(/*seed*/1);
+  SceneState scene_state;
+  Optional<BodyIndex> maybe_parent_index;
+  vector<MarkerIndex> end_markers;
+
+  for (int i = 0; i != n_bodies; ++i) {
+    BodyIndex body_index = scene_state.createBody(maybe_parent_index);
+    SceneState::Body &body_state = scene_state.body(body_index);
+    setAll(body_state.solve_flags.rotation, true);
+    setRandomRotation(body_state.transform.rotation, 30, engine);
+
+    if (maybe_parent_index) {
+      body_state.transform.translation.x = 1;
+    }
+
+    if (i >= n_bodies - n_errors) {
+      end_markers.push_back(addMarker(scene_state, {1,0,0}, body_index));
+    }
+
+    maybe_parent_index = body_index;
+  }
+
+  addTargetsFor(scene_state, end_markers);
+  perturbSolvedValues(scene_state, 0, 20, engine);
+  return scene_state;
+}
+
+
+// Like aruco.scn, where cameras that can move freely each see all of a
+// fixed set of global points.
+static SceneState makeCameraCloudScene(int n_cameras, int n_points)
+{
+  RandomEngine engine(/*seed*/1);
+  SceneState scene_state;
+  vector<MarkerIndex> point_markers;
+
+  for (int i = 0; i != n_points; ++i) {
+    point_markers.push_back(
+      addMarker(scene_state, randomPoint(5, engine), {})
+    );
+  }
+
+  for (int i = 0; i != n_cameras; ++i) {
+    BodyIndex body_index = scene_state.createBody();
+    SceneState::Body &body_state = scene_state.body(body_index);
+    setAll(body_state.solve_flags, true);
+    Point translation = randomPoint(10, engine);
+    body_state.transform.translation.x = translation.x();
+    body_state.transform.translation.y = translation.y();
+    body_state.transform.translation.z = translation.z();
+    setRandomRotation(body_state.transform.rotation, 90, engine);
+
+    Transform camera_global =
+      makeScaledTransformFromState(body_state.transform);
+
+    for (MarkerIndex point_marker_index : point_markers) {
+      Point global = markerPredicted(scene_state, point_marker_index);
+      Point local = camera_global.inverse()*global;
+      MarkerIndex seen_index = addMarker(scene_state, local, body_index);
+      addDistanceError(scene_state, seen_index, point_marker_index);
+    }
+  }
+
+  perturbSolvedValues(scene_state, 0.5, 10, engine);
+  return scene_state;
+}
+
+
+// Free root bodies, each with many free children that have a few markers
+// with targets.  The rigs don't depend on each other.
+static SceneState
+  makeWideRigScene(int n_rigs, int n_children, int n_markers_per_child)
+{
+  RandomEngine engine(/*seed*/1);
+  SceneState scene_state;
+  vector<MarkerIndex> markers;
+
+  for (int rig = 0; rig != n_rigs; ++rig) {
+    BodyIndex root_index = scene_state.createBody();
+    setAll(scene_state.body(root_index).solve_flags, true);
+
+    for (int i = 0; i != n_children; ++i) {
+      BodyIndex body_index = scene_state.createBody(root_index);
+      SceneState::Body &body_state = scene_state.body(body_index);
+      setAll(body_state.solve_flags, true);
+      Point translation = randomPoint(10, engine);
+      body_state.transform.translation.x = translation.x();
+      body_state.transform.translation.y = translation.y();
+      body_state.transform.translation.z = translation.z();
+      setRandomRotation(body_state.transform.rotation, 90, engine);
+
+      for (int j = 0; j != n_markers_per_child; ++j) {
+        markers.push_back(
+          addMarker(scene_state, randomPoint(1, engine), body_index)
+        );
+      }
+    }
+  }
+
+  addTargetsFor(scene_state, markers);
+  perturbSolvedValues(scene_state, 0.2, 10, engine);
+  return scene_state;
+}
+
+
+static int nSolvedValues(const SceneState &scene_state)
+{
+  int result = 0;
+
+  for (auto body_index : indicesOf(scene_state.bodies())) {
+    const SceneState::Body &body_state = scene_state.body(body_index);
+    const SceneState::TransformSolveFlags &flags = body_state.solve_flags;
+
+    forEachXYZComponent([&](XYZComponent c){
+      result += flags.translation.component(c);
+      result += flags.rotation.component(c);
+    });
+
+    result += flags.scale;
+  }
+
+  return result;
+}
+
+
+namespace {
+struct BenchmarkScene {
+  string name;
+  std::function<SceneState()> make_function;
+};
+}
+
+
+namespace {
+struct BenchmarkMethod {
+  string name;
+  SolveOptions options;
+};
+}
+
+
+static void
+  printRow(
+    const string &scene_name,
+    const string &method_name,
+    const string &n_variables,
+    const string &n_errors,
+    const string &n_evaluations,
+    const string &n_iterations,
+    const string &time_ms,
+    const string &total_error
+  )
+{
+  cout << std::left << std::setw(20) << scene_name;
+  cout << std::setw(16) << method_name;
+  cout << std::right;
+  cout << std::setw(10) << n_variables;
+  cout << std::setw(8) << n_errors;
+  cout << std::setw(12) << n_evaluations;
+  cout << std::setw(12) << n_iterations;
+  cout << std::setw(12) << time_ms;
+  cout << std::setw(14) << total_error;
+  cout << "\n";
+}
+
+
+static string str(double value)
+{
+  std::ostringstream stream;
+  stream << value;
+  return stream.str();
+}
+
+
+int main(int argc, char **argv)
+{
+  string filter = (argc > 1) ? argv[1] : "";
+  ThreadPool thread_pool;
+
+  vector<BenchmarkScene> scenes = {
+    {"chain_10", []{ return makeChainScene(10, 1); }},
+    {"chain_50", []{ return makeChainScene(50, 5); }},
+    {"cameras_4x20", []{ return makeCameraCloudScene(4, 20); }},
+    {"cameras_20x50", []{ return makeCameraCloudScene(20, 50); }},
+    {"cameras_4x1000", []{ return makeCameraCloudScene(4, 1000); }},
+    {"rig_20x3", []{ return makeWideRigScene(1, 20, 3); }},
+    {"rig_200x3", []{ return makeWideRigScene(1, 200, 3); }},
+    {"rigs_10x20x3", []{ return makeWideRigScene(10, 20, 3); }},
+  };
+
+  vector<BenchmarkMethod> methods(8);
+  methods[0].name = "cd";
+  methods[0].options.method = SolveMethod::coordinate_descent;
+  methods[1].name = "lm";
+  methods[1].options.method = SolveMethod::levenberg_marquardt;
+  methods[2].name = "lm_sparse";
+  methods[2].options.method = SolveMethod::sparse_levenberg_marquardt;
+  methods[3].name = "lm_joint";
+  methods[3].options.method = SolveMethod::levenberg_marquardt;
+  methods[3].options.split_into_components = false;
+  methods[4].name = "lm_threads";
+  methods[4].options.method = SolveMethod::levenberg_marquardt;
+  methods[4].options.thread_pool_ptr = &thread_pool;
+  methods[5].name = "lm_align";
+  methods[5].options.method = SolveMethod::levenberg_marquardt;
+  methods[5].options.align_rigid_bodies_first = true;
+  methods[6].name = "lm_fd";
+  methods[6].options.method = SolveMethod::levenberg_marquardt;
+  methods[6].options.finite_difference_jacobian = true;
+  methods[7].name = "lm_fd_threads";
+  methods[7].options.method = SolveMethod::levenberg_marquardt;
+  methods[7].options.finite_difference_jacobian = true;
+  methods[7].options.thread_pool_ptr = &thread_pool;
+
+  printRow(
+    "scene", "method", "variables", "errors", "evals", "iterations",
+    "time(ms)", "total_error"
+  );
+
+  for (const BenchmarkScene &scene : scenes) {
+    SceneState initial_state = scene.make_function();
+
+    for (const BenchmarkMethod &method : methods) {
+      string case_name = scene.name + " " + method.name;
+
+      if (case_name.find(filter) == string::npos) {
+        continue;
+      }
+
+      SceneState scene_state = initial_state;
+      auto start_time = std::chrono::steady_clock::now();
+      SolveStats stats = solveScene(scene_state, method.options);
+      auto end_time = std::chrono::steady_clock::now();
+
+      double time_ms =
+        std::chrono::duration<double, std::milli>(end_time - start_time)
+        .count();
+
+      printRow(
+        scene.name,
+        method.name,
+        str(nSolvedValues(scene_state)),
+        str(scene_state.distance_errors.size()),
+        str(stats.n_evaluations),
+        str(stats.n_iterations),
+        str(time_ms),
+        str(sceneError(scene_state))
+      );
+    }
+  }
+}
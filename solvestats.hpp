@@ -0,0 +1,50 @@
+#ifndef SOLVESTATS_HPP_
+#define SOLVESTATS_HPP_
+
+#include "vector.hpp"
+
+
+// Information about how a solve went.
+struct SolveStats {
+  int n_variables = 0;
+
+  // Variables that weren't solved because they don't affect any distance
+  // error.  These are included in n_variables.
+  int n_pruned_variables = 0;
+
+  // The number of times the total error was evaluated, including the
+  // evaluations of single variable changes.
+  int n_evaluations = 0;
+
+  // Passes over the variables for the coordinate descent, and steps taken
+  // for Levenberg-Marquardt.
+  int n_iterations = 0;
+
+  // Time spent setting the scene values from the variables and computing
+  // the global transforms of the bodies.  When only a single variable has
+  // changed, the affected transforms are computed as the errors need them,
+  // so that time is counted as error time instead.
+  double transform_seconds = 0;
+
+  // Time spent computing the distance errors and summing them, including
+  // the derivatives of the residuals.
+  double error_seconds = 0;
+
+  double total_seconds = 0;
+
+  // The total error before the first iteration, followed by the total
+  // error after each iteration.  For a scene with solve stages, the
+  // total error after each stage comes before the iterations of the final
+  // solve, and the iterations of the stages are included in n_iterations.
+  vector<float> error_history;
+
+  // The solve was stopped by its cancel flag before it finished.
+  bool was_cancelled = false;
+
+  // The solve was stopped by its time or evaluation budget before it
+  // converged.
+  bool ran_out_of_budget = false;
+};
+
+
+#endif /* SOLVESTATS_HPP_ */
@@ -0,0 +1,120 @@
+#include "threadpool.hpp"
+
+#include <cassert>
+
+
+ThreadPool::ThreadPool(size_t n_threads_arg)
+: n_threads(n_threads_arg)
+{
+  assert(n_threads >= 1);
+
+  for (size_t thread_index = 1; thread_index < n_threads; ++thread_index) {
+    threads.emplace_back([this, thread_index]{ runThread(thread_index); });
+  }
+}
+
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+
+  start_condition.notify_all();
+
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+}
+
+
+size_t ThreadPool::defaultThreadCount()
+{
+  size_t n = std::thread::hardware_concurrency();
+
+  if (n == 0) {
+    return 1;
+  }
+
+  return n;
+}
+
+
+void ThreadPool::runIndices(size_t thread_index)
+{
+  for (;;) {
+    size_t index = next_index++;
+
+    if (index >= n_indices) {
+      break;
+    }
+
+    (*function_ptr)(index, thread_index);
+  }
+}
+
+
+void ThreadPool::runThread(size_t thread_index)
+{
+  size_t last_generation = 0;
+
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+
+      start_condition.wait(lock, [&]{
+        return stopping || generation != last_generation;
+      });
+
+      if (stopping) {
+        return;
+      }
+
+      last_generation = generation;
+    }
+
+    runIndices(thread_index);
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      --n_running;
+    }
+
+    finish_condition.notify_one();
+  }
+}
+
+
+void ThreadPool::forEachIndex(size_t n, const IndexFunction &f)
+{
+  bool was_busy = busy.exchange(true);
+
+  if (was_busy || threads.empty() || n <= 1) {
+    for (size_t index = 0; index != n; ++index) {
+      f(index, /*thread_index*/0);
+    }
+
+    if (!was_busy) {
+      busy = false;
+    }
+
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    function_ptr = &f;
+    n_indices = n;
+    next_index = 0;
+    n_running = threads.size();
+    ++generation;
+  }
+
+  start_condition.notify_all();
+  runIndices(/*thread_index*/0);
+  std::unique_lock<std::mutex> lock(mutex);
+  finish_condition.wait(lock, [&]{ return n_running == 0; });
+  function_ptr = nullptr;
+  busy = false;
+}
@@ -0,0 +1,52 @@
+#ifndef THREADPOOL_HPP_
+#define THREADPOOL_HPP_
+
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "vector.hpp"
+
+
+// A fixed set of threads that can run a function for a range of indices.
+// The calling thread takes part, so a pool with one thread doesn't start
+// any other threads.
+class ThreadPool {
+  public:
+    using IndexFunction =
+      std::function<void(size_t index, size_t thread_index)>;
+
+    explicit ThreadPool(size_t n_threads = defaultThreadCount());
+    ~ThreadPool();
+
+    size_t nThreads() const { return n_threads; }
+
+    // Calls f for each index in [0,n), giving it the index of the thread
+    // that it is running on, which is less than nThreads().  Each thread
+    // takes the next unclaimed index when it finishes one, so uneven work
+    // gets balanced.  If the pool is already busy, as with a nested call,
+    // all the indices are run on the calling thread with thread index 0.
+    void forEachIndex(size_t n, const IndexFunction &f);
+
+    static size_t defaultThreadCount();
+
+  private:
+    const size_t n_threads;
+    vector<std::thread> threads;
+    std::atomic<bool> busy{false};
+    std::mutex mutex;
+    std::condition_variable start_condition;
+    std::condition_variable finish_condition;
+    size_t generation = 0;
+    size_t n_running = 0;
+    bool stopping = false;
+    const IndexFunction *function_ptr = nullptr;
+    size_t n_indices = 0;
+    std::atomic<size_t> next_index{0};
+
+    void runThread(size_t thread_index);
+    void runIndices(size_t thread_index);
+};
+
+#endif /* THREADPOOL_HPP_ */
@@ -0,0 +1,64 @@
+#include "threadpool.hpp"
+
+#include <cassert>
+
+
+static void testEachIndexIsRunOnce()
+{
+  ThreadPool thread_pool(/*n_threads*/4);
+  size_t n = 1000;
+
+  for (int pass = 0; pass != 3; ++pass) {
+    vector<int> counts(n, 0);
+
+    thread_pool.forEachIndex(n, [&](size_t index, size_t thread_index){
+      assert(thread_index < thread_pool.nThreads());
+      ++counts[index];
+    });
+
+    for (int count : counts) {
+      assert(count == 1);
+    }
+  }
+}
+
+
+static void testNestedCall()
+{
+  ThreadPool thread_pool(/*n_threads*/3);
+  size_t n = 10;
+  vector<int> counts(n*n, 0);
+
+  thread_pool.forEachIndex(n, [&](size_t i, size_t){
+    thread_pool.forEachIndex(n, [&](size_t j, size_t thread_index){
+      assert(thread_index == 0);
+      ++counts[i*n + j];
+    });
+  });
+
+  for (int count : counts) {
+    assert(count == 1);
+  }
+}
+
+
+static void testSingleThread()
+{
+  ThreadPool thread_pool(/*n_threads*/1);
+  int total = 0;
+
+  thread_pool.forEachIndex(5, [&](size_t index, size_t thread_index){
+    assert(thread_index == 0);
+    total += index;
+  });
+
+  assert(total == 10);
+}
+
+
+int main()
+{
+  testEachIndexIsRunOnce();
+  testNestedCall();
+  testSingleThread();
+}
@@ -16,10 +16,12 @@ TransformState transformState(const Transform &t, float scale)
 
 Transform makeScaledTransformFromState(const SceneState::Transform &arg)
 {
-  Transform box_global = Transform::Identity();
+  Transform box_global;
+
+  box_global.linear() =
+    makeRotation(vec3FromXYZState(arg.rotation)*(M_PI/180))*arg.scale;
+
   setTransformTranslation(box_global, vec3FromXYZState(arg.translation));
-  setTransformRotationDeg(box_global, vec3FromXYZState(arg.rotation));
-  scaleTransform(box_global, arg.scale);
   return box_global;
 }
 
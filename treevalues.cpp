@@ -1188,10 +1188,29 @@ updateDistanceError(
 }
 
 
-static string totalErrorLabel(float total_error)
+static string
+  totalErrorLabel(
+    float total_error,
+    const SolveStats *solve_stats_ptr = nullptr
+  )
 {
   std::ostringstream label_stream;
   label_stream << "total_error: " << total_error;
+
+  if (solve_stats_ptr) {
+    const SolveStats &stats = *solve_stats_ptr;
+    label_stream << " (";
+    label_stream << stats.n_variables << " variables, ";
+
+    if (stats.n_pruned_variables != 0) {
+      label_stream << stats.n_pruned_variables << " pruned, ";
+    }
+
+    label_stream << stats.n_iterations << " iterations, ";
+    label_stream << stats.n_evaluations << " evaluations, ";
+    label_stream << stats.total_seconds*1000 << " ms)";
+  }
+
   return label_stream.str();
 }
 
@@ -2076,7 +2095,8 @@ void
   updateTreeValues(
     TreeWidget &tree_widget,
     const TreePaths &tree_paths,
-    const SceneState &state
+    const SceneState &state,
+    const SolveStats *solve_stats_ptr
   )
 {
   for (auto body_index : indicesOf(state.bodies())) {
@@ -2096,7 +2116,7 @@ void
   }
 
   tree_widget.setItemLabel(
-    tree_paths.total_error, totalErrorLabel(state.total_error)
+    tree_paths.total_error, totalErrorLabel(state.total_error, solve_stats_ptr)
   );
 }
 
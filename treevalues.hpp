@@ -4,6 +4,7 @@
 #include "stringvalue.hpp"
 #include "channel.hpp"
 #include "sceneelementdescription.hpp"
+#include "solvestats.hpp"
 
 
 struct SceneTreeRef {
@@ -15,11 +16,13 @@ struct SceneTreeRef {
 extern TreePaths fillTree(TreeWidget &, const SceneState &);
 extern void clearTree(TreeWidget &, const TreePaths &);
 
+// If solve_stats_ptr is given, the stats are shown with the total error.
 extern void
   updateTreeValues(
     TreeWidget &tree_widget,
     const TreePaths &tree_paths,
-    const SceneState &state
+    const SceneState &state,
+    const SolveStats *solve_stats_ptr = nullptr
   );
 
 extern void